@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+//addAddress.comp.spvをそのまま埋め込んだもの。バッファをデバイスアドレスで受け取るadd.compの別版。
+//addAddress.compを変えたら addAddress.comp.spv と一緒に作り直すこと。
+constexpr uint32_t AddAddressCompSpirv[] =
+{
+	0x07230203, 0x00010000, 0x00000000, 0x00000030, 0x00000000, 0x00020011, 0x00000001, 0x00020011,
+	0x000014e3, 0x0009000a, 0x5f565053, 0x5f52484b, 0x73796870, 0x6c616369, 0x6f74735f, 0x65676172,
+	0x6675625f, 0x00726566, 0x0003000e, 0x000014e4, 0x00000001, 0x0007000f, 0x00000005, 0x00000001,
+	0x6e69616d, 0x00000000, 0x00000002, 0x00000003, 0x00060010, 0x00000001, 0x00000011, 0x00000008,
+	0x00000004, 0x00000001, 0x00030003, 0x00000002, 0x000001c2, 0x00040005, 0x00000001, 0x6e69616d,
+	0x00000000, 0x00050005, 0x00000004, 0x616f6c46, 0x72724174, 0x00007961, 0x00050006, 0x00000004,
+	0x00000000, 0x61746164, 0x00000000, 0x00050005, 0x00000005, 0x61726150, 0x6574656d, 0x00007372,
+	0x00060006, 0x00000005, 0x00000000, 0x7074756f, 0x61447475, 0x00006174, 0x00070006, 0x00000005,
+	0x00000001, 0x6d656c65, 0x43746e65, 0x746e756f, 0x00000000, 0x00050005, 0x00000006, 0x61726170,
+	0x6574656d, 0x00007372, 0x00040005, 0x00000007, 0x756c6176, 0x00000065, 0x00040047, 0x00000002,
+	0x0000000b, 0x0000001c, 0x00040047, 0x00000003, 0x0000000b, 0x00000018, 0x00040047, 0x00000008,
+	0x00000006, 0x00000004, 0x00050048, 0x00000004, 0x00000000, 0x00000023, 0x00000000, 0x00030047,
+	0x00000004, 0x00000002, 0x00050048, 0x00000005, 0x00000000, 0x00000023, 0x00000000, 0x00050048,
+	0x00000005, 0x00000001, 0x00000023, 0x00000008, 0x00030047, 0x00000005, 0x00000002, 0x00040047,
+	0x00000007, 0x00000001, 0x00000003, 0x00020013, 0x00000009, 0x00030021, 0x0000000a, 0x00000009,
+	0x00040015, 0x0000000b, 0x00000020, 0x00000000, 0x00040015, 0x0000000c, 0x00000020, 0x00000001,
+	0x00030016, 0x0000000d, 0x00000020, 0x00020014, 0x0000000e, 0x00040017, 0x0000000f, 0x0000000b,
+	0x00000003, 0x00040020, 0x00000010, 0x00000001, 0x0000000f, 0x0004003b, 0x00000010, 0x00000002,
+	0x00000001, 0x0004003b, 0x00000010, 0x00000003, 0x00000001, 0x00040020, 0x00000011, 0x00000001,
+	0x0000000b, 0x0004002b, 0x0000000b, 0x00000012, 0x00000000, 0x0004002b, 0x0000000b, 0x00000013,
+	0x00000001, 0x0004002b, 0x0000000b, 0x00000014, 0x00000008, 0x0004002b, 0x0000000c, 0x00000015,
+	0x00000000, 0x0004002b, 0x0000000c, 0x00000016, 0x00000001, 0x00030027, 0x00000017, 0x000014e5,
+	0x0004001e, 0x00000005, 0x00000017, 0x0000000b, 0x0003001d, 0x00000008, 0x0000000d, 0x0003001e,
+	0x00000004, 0x00000008, 0x00040020, 0x00000017, 0x000014e5, 0x00000004, 0x00040020, 0x00000018,
+	0x00000009, 0x00000005, 0x0004003b, 0x00000018, 0x00000006, 0x00000009, 0x00040020, 0x00000019,
+	0x00000009, 0x0000000b, 0x00040020, 0x0000001a, 0x00000009, 0x00000017, 0x00040020, 0x0000001b,
+	0x000014e5, 0x0000000d, 0x00040032, 0x0000000d, 0x00000007, 0x3f800000, 0x00050036, 0x00000009,
+	0x00000001, 0x00000000, 0x0000000a, 0x000200f8, 0x0000001c, 0x00050041, 0x00000011, 0x0000001d,
+	0x00000002, 0x00000012, 0x0004003d, 0x0000000b, 0x0000001e, 0x0000001d, 0x00050041, 0x00000011,
+	0x0000001f, 0x00000002, 0x00000013, 0x0004003d, 0x0000000b, 0x00000020, 0x0000001f, 0x00050041,
+	0x00000011, 0x00000021, 0x00000003, 0x00000012, 0x0004003d, 0x0000000b, 0x00000022, 0x00000021,
+	0x00050084, 0x0000000b, 0x00000023, 0x00000014, 0x00000022, 0x00050084, 0x0000000b, 0x00000024,
+	0x00000020, 0x00000023, 0x00050080, 0x0000000b, 0x00000025, 0x0000001e, 0x00000024, 0x00050041,
+	0x00000019, 0x00000026, 0x00000006, 0x00000016, 0x0004003d, 0x0000000b, 0x00000027, 0x00000026,
+	0x000500b0, 0x0000000e, 0x00000028, 0x00000025, 0x00000027, 0x000300f7, 0x00000029, 0x00000000,
+	0x000400fa, 0x00000028, 0x0000002a, 0x00000029, 0x000200f8, 0x0000002a, 0x00050041, 0x0000001a,
+	0x0000002b, 0x00000006, 0x00000015, 0x0004003d, 0x00000017, 0x0000002c, 0x0000002b, 0x00060041,
+	0x0000001b, 0x0000002d, 0x0000002c, 0x00000015, 0x00000025, 0x0006003d, 0x0000000d, 0x0000002e,
+	0x0000002d, 0x00000002, 0x00000004, 0x00050081, 0x0000000d, 0x0000002f, 0x0000002e, 0x00000007,
+	0x0005003e, 0x0000002d, 0x0000002f, 0x00000002, 0x00000004, 0x000200f9, 0x00000029, 0x000200f8,
+	0x00000029, 0x000100fd, 0x00010038,
+};
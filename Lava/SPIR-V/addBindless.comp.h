@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+//addBindless.comp.spvをそのまま埋め込んだもの。バッファをbindlessの配列の添字で受け取るadd.compの別版。
+//addBindless.compを変えたら addBindless.comp.spv と一緒に作り直すこと。
+constexpr uint32_t AddBindlessCompSpirv[] =
+{
+	0x07230203, 0x00010000, 0x00000000, 0x00000035, 0x00000000, 0x00020011, 0x00000001, 0x00020011,
+	0x0000001e, 0x00020011, 0x000014b6, 0x0008000a, 0x5f565053, 0x5f545845, 0x63736564, 0x74706972,
+	0x695f726f, 0x7865646e, 0x00676e69, 0x0003000e, 0x00000000, 0x00000001, 0x0007000f, 0x00000005,
+	0x00000001, 0x6e69616d, 0x00000000, 0x00000002, 0x00000003, 0x00060010, 0x00000001, 0x00000011,
+	0x00000008, 0x00000004, 0x00000001, 0x00030003, 0x00000002, 0x000001c2, 0x00040005, 0x00000001,
+	0x6e69616d, 0x00000000, 0x00040005, 0x00000004, 0x66667542, 0x00737265, 0x00050006, 0x00000004,
+	0x00000000, 0x61746164, 0x00000000, 0x00040005, 0x00000005, 0x66667562, 0x00737265, 0x00050005,
+	0x00000006, 0x61726150, 0x6574656d, 0x00007372, 0x00060006, 0x00000006, 0x00000000, 0x66667562,
+	0x6e497265, 0x00786564, 0x00070006, 0x00000006, 0x00000001, 0x6d656c65, 0x43746e65, 0x746e756f,
+	0x00000000, 0x00070006, 0x00000006, 0x00000002, 0x6d656c65, 0x4f746e65, 0x65736666, 0x00000074,
+	0x00050005, 0x00000007, 0x61726170, 0x6574656d, 0x00007372, 0x00040005, 0x00000008, 0x756c6176,
+	0x00000065, 0x00040047, 0x00000002, 0x0000000b, 0x0000001c, 0x00040047, 0x00000003, 0x0000000b,
+	0x00000018, 0x00040047, 0x00000009, 0x00000006, 0x00000004, 0x00050048, 0x00000004, 0x00000000,
+	0x00000023, 0x00000000, 0x00030047, 0x00000004, 0x00000003, 0x00040047, 0x00000005, 0x00000022,
+	0x00000000, 0x00040047, 0x00000005, 0x00000021, 0x00000000, 0x00050048, 0x00000006, 0x00000000,
+	0x00000023, 0x00000000, 0x00050048, 0x00000006, 0x00000001, 0x00000023, 0x00000004, 0x00050048,
+	0x00000006, 0x00000002, 0x00000023, 0x00000008, 0x00030047, 0x00000006, 0x00000002, 0x00040047,
+	0x00000008, 0x00000001, 0x00000003, 0x00020013, 0x0000000a, 0x00030021, 0x0000000b, 0x0000000a,
+	0x00040015, 0x0000000c, 0x00000020, 0x00000000, 0x00040015, 0x0000000d, 0x00000020, 0x00000001,
+	0x00030016, 0x0000000e, 0x00000020, 0x00020014, 0x0000000f, 0x00040017, 0x00000010, 0x0000000c,
+	0x00000003, 0x00040020, 0x00000011, 0x00000001, 0x00000010, 0x0004003b, 0x00000011, 0x00000002,
+	0x00000001, 0x0004003b, 0x00000011, 0x00000003, 0x00000001, 0x00040020, 0x00000012, 0x00000001,
+	0x0000000c, 0x0004002b, 0x0000000c, 0x00000013, 0x00000000, 0x0004002b, 0x0000000c, 0x00000014,
+	0x00000001, 0x0004002b, 0x0000000c, 0x00000015, 0x00000008, 0x0004002b, 0x0000000d, 0x00000016,
+	0x00000000, 0x0004002b, 0x0000000d, 0x00000017, 0x00000001, 0x0004002b, 0x0000000d, 0x00000018,
+	0x00000002, 0x0003001d, 0x00000009, 0x0000000e, 0x0003001e, 0x00000004, 0x00000009, 0x0003001d,
+	0x00000019, 0x00000004, 0x00040020, 0x0000001a, 0x00000002, 0x00000019, 0x0004003b, 0x0000001a,
+	0x00000005, 0x00000002, 0x0005001e, 0x00000006, 0x0000000c, 0x0000000c, 0x0000000c, 0x00040020,
+	0x0000001b, 0x00000009, 0x00000006, 0x0004003b, 0x0000001b, 0x00000007, 0x00000009, 0x00040020,
+	0x0000001c, 0x00000009, 0x0000000c, 0x00040020, 0x0000001d, 0x00000002, 0x0000000e, 0x00040032,
+	0x0000000e, 0x00000008, 0x3f800000, 0x00050036, 0x0000000a, 0x00000001, 0x00000000, 0x0000000b,
+	0x000200f8, 0x0000001e, 0x00050041, 0x00000012, 0x0000001f, 0x00000002, 0x00000013, 0x0004003d,
+	0x0000000c, 0x00000020, 0x0000001f, 0x00050041, 0x00000012, 0x00000021, 0x00000002, 0x00000014,
+	0x0004003d, 0x0000000c, 0x00000022, 0x00000021, 0x00050041, 0x00000012, 0x00000023, 0x00000003,
+	0x00000013, 0x0004003d, 0x0000000c, 0x00000024, 0x00000023, 0x00050084, 0x0000000c, 0x00000025,
+	0x00000015, 0x00000024, 0x00050084, 0x0000000c, 0x00000026, 0x00000022, 0x00000025, 0x00050080,
+	0x0000000c, 0x00000027, 0x00000020, 0x00000026, 0x00050041, 0x0000001c, 0x00000028, 0x00000007,
+	0x00000017, 0x0004003d, 0x0000000c, 0x00000029, 0x00000028, 0x000500b0, 0x0000000f, 0x0000002a,
+	0x00000027, 0x00000029, 0x000300f7, 0x0000002b, 0x00000000, 0x000400fa, 0x0000002a, 0x0000002c,
+	0x0000002b, 0x000200f8, 0x0000002c, 0x00050041, 0x0000001c, 0x0000002d, 0x00000007, 0x00000016,
+	0x0004003d, 0x0000000c, 0x0000002e, 0x0000002d, 0x00050041, 0x0000001c, 0x0000002f, 0x00000007,
+	0x00000018, 0x0004003d, 0x0000000c, 0x00000030, 0x0000002f, 0x00050080, 0x0000000c, 0x00000031,
+	0x00000030, 0x00000027, 0x00070041, 0x0000001d, 0x00000032, 0x00000005, 0x0000002e, 0x00000016,
+	0x00000031, 0x0004003d, 0x0000000e, 0x00000033, 0x00000032, 0x00050081, 0x0000000e, 0x00000034,
+	0x00000033, 0x00000008, 0x0003003e, 0x00000032, 0x00000034, 0x000200f9, 0x0000002b, 0x000200f8,
+	0x0000002b, 0x000100fd, 0x00010038,
+};
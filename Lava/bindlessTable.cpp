@@ -0,0 +1,293 @@
+#include "bindlessTable.h"
+
+BindlessTable::BindlessTable()
+{
+	device = VK_NULL_HANDLE;
+	errors = nullptr;
+	setLayout = VK_NULL_HANDLE;
+	pool = VK_NULL_HANDLE;
+	set = VK_NULL_HANDLE;
+	bufferCapacity = 0u;
+	imageCapacity = 0u;
+	nextBuffer = 0u;
+	nextImage = 0u;
+}
+
+//容量はデバイスのmaxDescriptorSetUpdateAfterBind*に収めて渡すこと
+void BindlessTable::create(VkDevice device, uint32_t bufferCapacity, uint32_t imageCapacity, vector<const char*>& errors)
+{
+	this->device = device;
+	this->errors = &errors;
+	this->bufferCapacity = bufferCapacity;
+	this->imageCapacity = imageCapacity;
+	liveBuffers.assign(bufferCapacity, false);
+	liveImages.assign(imageCapacity, false);
+
+	//登録していない要素が残っていてよく、使っていない要素は実行中でも書き換えてよい
+	const VkDescriptorBindingFlags bindingFlags[] = {
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+	};
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = BindlessBufferBinding;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = bufferCapacity;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[0].pImmutableSamplers = nullptr;
+	bindings[1].binding = BindlessImageBinding;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = imageCapacity;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].pImmutableSamplers = nullptr;
+	const uint32_t bindingCount = imageCapacity != 0u ? 2u : 1u;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCI{};
+	bindingFlagsCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCI.pNext = nullptr;
+	bindingFlagsCI.bindingCount = bindingCount;
+	bindingFlagsCI.pBindingFlags = bindingFlags;
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+	descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCI.pNext = &bindingFlagsCI;
+	descriptorSetLayoutCI.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	descriptorSetLayoutCI.bindingCount = bindingCount;
+	descriptorSetLayoutCI.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &setLayout) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateDescriptorSetLayout is failed in BindlessTable::create");
+		return;
+	}
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = bufferCapacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = imageCapacity;
+	VkDescriptorPoolCreateInfo descriptorPoolCI{};
+	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCI.pNext = nullptr;
+	descriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	descriptorPoolCI.maxSets = 1u;
+	descriptorPoolCI.poolSizeCount = bindingCount;
+	descriptorPoolCI.pPoolSizes = poolSizes;
+	if (vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &pool) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateDescriptorPool is failed in BindlessTable::create");
+		return;
+	}
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocInfo.pNext = nullptr;
+	descriptorSetAllocInfo.descriptorPool = pool;
+	descriptorSetAllocInfo.descriptorSetCount = 1u;
+	descriptorSetAllocInfo.pSetLayouts = &setLayout;
+	if (vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &set) != VK_SUCCESS)
+	{
+		errors.push_back("vkAllocateDescriptorSets is failled in BindlessTable::create");
+		set = VK_NULL_HANDLE;
+	}
+}
+
+void BindlessTable::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//セットはプールと一緒に解放される
+	vkDestroyDescriptorPool(device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+	pool = VK_NULL_HANDLE;
+	setLayout = VK_NULL_HANDLE;
+	set = VK_NULL_HANDLE;
+	nextBuffer = 0u;
+	nextImage = 0u;
+	freeBuffers.clear();
+	freeImages.clear();
+	liveBuffers.clear();
+	liveImages.clear();
+	retired.clear();
+	device = VK_NULL_HANDLE;
+}
+
+bool BindlessTable::ready() const
+{
+	return set != VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::acquire(uint32_t& next, vector<uint32_t>& freeHandles, vector<bool>& live, uint32_t capacity)
+{
+	if (!freeHandles.empty())
+	{
+		const uint32_t handle = freeHandles.back();
+		freeHandles.pop_back();
+		live[handle] = true;
+		return handle;
+	}
+	if (next >= capacity)
+	{
+		return BindlessInvalidHandle;
+	}
+	live[next] = true;
+	return next++;
+}
+
+//登録されていない添字を空きに積むと、次の登録で2つのバッファが同じ添字を取り合うので弾く
+bool BindlessTable::release(uint32_t handle, vector<uint32_t>& freeHandles, vector<bool>& live)
+{
+	if (handle >= live.size() || !live[handle])
+	{
+		return false;
+	}
+	live[handle] = false;
+	freeHandles.push_back(handle);
+	return true;
+}
+
+void BindlessTable::write(uint32_t binding, uint32_t handle, VkDescriptorType descriptorType, const VkDescriptorBufferInfo* bufferInfo, const VkDescriptorImageInfo* imageInfo)
+{
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.pNext = nullptr;
+	writeDescriptorSet.dstSet = set;
+	writeDescriptorSet.dstBinding = binding;
+	writeDescriptorSet.dstArrayElement = handle;
+	writeDescriptorSet.descriptorCount = 1u;
+	writeDescriptorSet.descriptorType = descriptorType;
+	writeDescriptorSet.pImageInfo = imageInfo;
+	writeDescriptorSet.pBufferInfo = bufferInfo;
+	writeDescriptorSet.pTexelBufferView = nullptr;
+	vkUpdateDescriptorSets(device, 1u, &writeDescriptorSet, 0u, nullptr);
+}
+
+uint32_t BindlessTable::registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	if (!ready())
+	{
+		return BindlessInvalidHandle;
+	}
+	const uint32_t handle = acquire(nextBuffer, freeBuffers, liveBuffers, bufferCapacity);
+	if (handle == BindlessInvalidHandle)
+	{
+		errors->push_back("bindless buffer array is full in BindlessTable::registerBuffer");
+		return BindlessInvalidHandle;
+	}
+	VkDescriptorBufferInfo descriptorBufferInfo{};
+	descriptorBufferInfo.buffer = buffer;
+	descriptorBufferInfo.offset = offset;
+	descriptorBufferInfo.range = range;
+	write(BindlessBufferBinding, handle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descriptorBufferInfo, nullptr);
+	return handle;
+}
+
+//ストレージイメージはimageLayoutのまま読み書きする。普通はVK_IMAGE_LAYOUT_GENERAL。
+uint32_t BindlessTable::registerImage(VkImageView imageView, VkImageLayout imageLayout)
+{
+	if (!ready())
+	{
+		return BindlessInvalidHandle;
+	}
+	const uint32_t handle = acquire(nextImage, freeImages, liveImages, imageCapacity);
+	if (handle == BindlessInvalidHandle)
+	{
+		errors->push_back("bindless image array is full in BindlessTable::registerImage");
+		return BindlessInvalidHandle;
+	}
+	VkDescriptorImageInfo descriptorImageInfo{};
+	descriptorImageInfo.sampler = VK_NULL_HANDLE;
+	descriptorImageInfo.imageView = imageView;
+	descriptorImageInfo.imageLayout = imageLayout;
+	write(BindlessImageBinding, handle, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &descriptorImageInfo);
+	return handle;
+}
+
+//登録済みの要素を別のバッファに向け直す。その要素を使うサブミットが完了してから呼ぶこと。
+bool BindlessTable::updateBuffer(uint32_t handle, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	if (!ready())
+	{
+		return false;
+	}
+	if (handle >= liveBuffers.size() || !liveBuffers[handle])
+	{
+		errors->push_back("handle is not registered in BindlessTable::updateBuffer");
+		return false;
+	}
+	VkDescriptorBufferInfo descriptorBufferInfo{};
+	descriptorBufferInfo.buffer = buffer;
+	descriptorBufferInfo.offset = offset;
+	descriptorBufferInfo.range = range;
+	write(BindlessBufferBinding, handle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descriptorBufferInfo, nullptr);
+	return true;
+}
+
+//PARTIALLY_BOUNDなので、要素は書き換えずに残しておいてよい
+void BindlessTable::unregisterBuffer(uint32_t handle)
+{
+	if (!ready())
+	{
+		return;
+	}
+	if (!release(handle, freeBuffers, liveBuffers))
+	{
+		errors->push_back("handle is not registered in BindlessTable::unregisterBuffer");
+	}
+}
+
+void BindlessTable::unregisterImage(uint32_t handle)
+{
+	if (!ready())
+	{
+		return;
+	}
+	if (!release(handle, freeImages, liveImages))
+	{
+		errors->push_back("handle is not registered in BindlessTable::unregisterImage");
+	}
+}
+
+void BindlessTable::retireBuffer(uint32_t handle, uint64_t ticket)
+{
+	if (ticket == 0u)
+	{
+		unregisterBuffer(handle);
+		return;
+	}
+	retired.push_back({ handle, ticket });
+}
+
+void BindlessTable::collect(const function<bool(uint64_t ticket)>& completed)
+{
+	size_t kept = 0u;
+	for (size_t i = 0; i < retired.size(); i++)
+	{
+		if (completed(retired[i].ticket))
+		{
+			unregisterBuffer(retired[i].handle);
+			continue;
+		}
+		retired[kept++] = retired[i];
+	}
+	retired.resize(kept);
+}
+
+VkDescriptorSetLayout BindlessTable::descriptorSetLayout() const
+{
+	return setLayout;
+}
+
+VkDescriptorSet BindlessTable::descriptorSet() const
+{
+	return set;
+}
+
+uint32_t BindlessTable::bufferCount() const
+{
+	return nextBuffer - uint32_t(freeBuffers.size());
+}
+
+uint32_t BindlessTable::imageCount() const
+{
+	return nextImage - uint32_t(freeImages.size());
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+//登録できなかった時のハンドル
+static const uint32_t BindlessInvalidHandle = UINT32_MAX;
+//カーネルからはset 0のこのbindingの配列として見える
+static const uint32_t BindlessBufferBinding = 0u;
+static const uint32_t BindlessImageBinding = 1u;
+
+//Vulkan 1.2のdescriptor indexingで、全てのカーネルが共有する1つのセットにストレージバッファとストレージイメージの大きな配列を置く。
+//バッファは一度登録すれば配列の添字をハンドルとして使え、カーネルはそれをpush_constantで受け取る。
+//セットはUPDATE_AFTER_BINDで作るので、実行中のサブミットが使っていない要素はいつでも書き換えられる。
+class BindlessTable
+{
+public:
+	BindlessTable();
+	//imageCapacityが0ならイメージの配列を持たない
+	void create(VkDevice device, uint32_t bufferCapacity, uint32_t imageCapacity, vector<const char*>& errors);
+	void destroy();
+	bool ready() const;
+	//空きが無ければBindlessInvalidHandleを返す
+	uint32_t registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	uint32_t registerImage(VkImageView imageView, VkImageLayout imageLayout);
+	bool updateBuffer(uint32_t handle, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	//ハンドルを使うサブミットが完了してから呼ぶこと。空いた添字は次の登録で使い回す。
+	//登録されていないハンドルはエラーを積んで無視する。
+	void unregisterBuffer(uint32_t handle);
+	void unregisterImage(uint32_t handle);
+	//ticketのサブミットが完了したらcollectで登録を外す
+	void retireBuffer(uint32_t handle, uint64_t ticket);
+	void collect(const function<bool(uint64_t ticket)>& completed);
+	VkDescriptorSetLayout descriptorSetLayout() const;
+	VkDescriptorSet descriptorSet() const;
+	//今登録されている数
+	uint32_t bufferCount() const;
+	uint32_t imageCount() const;
+private:
+	struct Retired
+	{
+		uint32_t handle;
+		uint64_t ticket;
+	};
+	VkDevice device;
+	vector<const char*>* errors;
+	VkDescriptorSetLayout setLayout;
+	VkDescriptorPool pool;
+	VkDescriptorSet set;
+	uint32_t bufferCapacity;
+	uint32_t imageCapacity;
+	//まだ一度も使っていない添字の先頭と、解放された添字
+	uint32_t nextBuffer;
+	uint32_t nextImage;
+	vector<uint32_t> freeBuffers;
+	vector<uint32_t> freeImages;
+	//添字ごとに今登録されているか
+	vector<bool> liveBuffers;
+	vector<bool> liveImages;
+	vector<Retired> retired;
+	static uint32_t acquire(uint32_t& next, vector<uint32_t>& freeHandles, vector<bool>& live, uint32_t capacity);
+	static bool release(uint32_t handle, vector<uint32_t>& freeHandles, vector<bool>& live);
+	void write(uint32_t binding, uint32_t handle, VkDescriptorType descriptorType, const VkDescriptorBufferInfo* bufferInfo, const VkDescriptorImageInfo* imageInfo);
+};
@@ -0,0 +1,219 @@
+#include "bufferArena.h"
+
+BufferArena::BufferArena()
+{
+	allocator = VK_NULL_HANDLE;
+	pool = VK_NULL_HANDLE;
+	errors = nullptr;
+	blockSize = 0u;
+	limit = 0u;
+	alignment = 1u;
+	usage = 0u;
+	ranges = 0u;
+	used = 0u;
+}
+
+//ブロックは最初に切り出す時に作る
+void BufferArena::create(VmaAllocator allocator, VmaPool pool, VkDeviceSize blockSize, VkDeviceSize rangeLimit, VkDeviceSize alignment, VkBufferUsageFlags usage, const vector<uint32_t>& queueFamilyIndices, vector<const char*>& errors)
+{
+	this->allocator = allocator;
+	this->pool = pool;
+	this->errors = &errors;
+	this->blockSize = blockSize;
+	this->limit = rangeLimit < blockSize ? rangeLimit : blockSize;
+	this->alignment = alignment != 0u ? alignment : 1u;
+	this->usage = usage;
+	this->queueFamilyIndices = queueFamilyIndices;
+}
+
+void BufferArena::destroy()
+{
+	if (allocator == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//切り出したままの範囲があっても、ブロックごとまとめて破棄する
+	for (auto& block : blocks)
+	{
+		vmaClearVirtualBlock(block.virtualBlock);
+		vmaDestroyVirtualBlock(block.virtualBlock);
+		vmaDestroyBuffer(allocator, block.buffer, block.allocation);
+	}
+	blocks.clear();
+	ranges = 0u;
+	used = 0u;
+	allocator = VK_NULL_HANDLE;
+}
+
+VkBufferCreateInfo BufferArena::blockBufferCreateInfo() const
+{
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	//末尾の配列もrangeLimitの範囲で結び付けられるよう、その分だけ大きく取る
+	bufferCI.size = blockSize + limit;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = queueFamilyIndices.size() > 1u ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = queueFamilyIndices.size() > 1u ? uint32_t(queueFamilyIndices.size()) : 0u;
+	bufferCI.pQueueFamilyIndices = queueFamilyIndices.size() > 1u ? queueFamilyIndices.data() : nullptr;
+	return bufferCI;
+}
+
+bool BufferArena::createBlock()
+{
+	VmaAllocationCreateInfo blockAllocInfo{};
+	blockAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	blockAllocInfo.pool = pool;
+	const VkBufferCreateInfo bufferCI = blockBufferCreateInfo();
+	Block block{};
+	if (vmaCreateBuffer(allocator, &bufferCI, &blockAllocInfo, &block.buffer, &block.allocation, nullptr) != VK_SUCCESS)
+	{
+		errors->push_back("vmaCreateBuffer failled in BufferArena::createBlock");
+		return false;
+	}
+	VmaVirtualBlockCreateInfo virtualBlockCI{};
+	virtualBlockCI.size = blockSize;
+	virtualBlockCI.flags = 0u;
+	virtualBlockCI.pAllocationCallbacks = nullptr;
+	if (vmaCreateVirtualBlock(&virtualBlockCI, &block.virtualBlock) != VK_SUCCESS)
+	{
+		errors->push_back("vmaCreateVirtualBlock failled in BufferArena::createBlock");
+		vmaDestroyBuffer(allocator, block.buffer, block.allocation);
+		return false;
+	}
+	blocks.push_back(block);
+	return true;
+}
+
+//先に作ったブロックから順に空きを探し、どこにも無ければ新しいブロックから切り出す
+bool BufferArena::allocate(VkDeviceSize size, ArenaRange& range)
+{
+	range = {};
+	if (size == 0u || size > limit)
+	{
+		errors->push_back("arena range exceeds range limit in BufferArena::allocate");
+		return false;
+	}
+	VmaVirtualAllocationCreateInfo virtualAllocCI{};
+	virtualAllocCI.size = size;
+	virtualAllocCI.alignment = alignment;
+	virtualAllocCI.flags = 0u;
+	virtualAllocCI.pUserData = nullptr;
+	VkDeviceSize offset = 0u;
+	uint32_t block = 0u;
+	while (block < uint32_t(blocks.size()) && vmaVirtualAllocate(blocks[block].virtualBlock, &virtualAllocCI, &range.allocation, &offset) != VK_SUCCESS)
+	{
+		block++;
+	}
+	if (block == uint32_t(blocks.size()))
+	{
+		if (!createBlock() || vmaVirtualAllocate(blocks[block].virtualBlock, &virtualAllocCI, &range.allocation, &offset) != VK_SUCCESS)
+		{
+			errors->push_back("vmaVirtualAllocate failled in BufferArena::allocate");
+			range = {};
+			return false;
+		}
+	}
+	range.offset = offset;
+	range.range = size;
+	range.block = block;
+	ranges++;
+	used += size;
+	return true;
+}
+
+void BufferArena::free(ArenaRange& range)
+{
+	if (!valid(range))
+	{
+		return;
+	}
+	vmaVirtualFree(blocks[range.block].virtualBlock, range.allocation);
+	ranges--;
+	used -= range.range;
+	range = {};
+}
+
+uint32_t BufferArena::blockCount() const
+{
+	return uint32_t(blocks.size());
+}
+
+VkBuffer BufferArena::blockBuffer(uint32_t block) const
+{
+	return blocks[block].buffer;
+}
+
+bool BufferArena::valid(const ArenaRange& range) const
+{
+	return range.range != 0u && range.block < uint32_t(blocks.size());
+}
+
+VkDeviceSize BufferArena::rangeLimit() const
+{
+	return limit;
+}
+
+VkDeviceSize BufferArena::blockBufferSize() const
+{
+	return blockSize + limit;
+}
+
+uint32_t BufferArena::rangeCount() const
+{
+	return ranges;
+}
+
+VkDeviceSize BufferArena::usedBytes() const
+{
+	return used;
+}
+
+bool BufferArena::createMovedBuffer(VmaAllocation allocation, VmaAllocation dstAllocation, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size)
+{
+	for (auto& block : blocks)
+	{
+		if (block.allocation != allocation)
+		{
+			continue;
+		}
+		const VkBufferCreateInfo bufferCI = blockBufferCreateInfo();
+		if (vmaCreateAliasingBuffer(allocator, dstAllocation, &bufferCI, &dstBuffer) != VK_SUCCESS)
+		{
+			errors->push_back("vmaCreateAliasingBuffer failled in BufferArena::createMovedBuffer");
+			return false;
+		}
+		srcBuffer = block.buffer;
+		size = bufferCI.size;
+		return true;
+	}
+	return false;
+}
+
+//VMAはパスを終えるとallocationの中身を移し先のメモリに入れ替えるので、allocationはそのまま持ち続ける
+bool BufferArena::findBlock(VmaAllocation allocation, uint32_t& block) const
+{
+	for (block = 0u; block < uint32_t(blocks.size()); block++)
+	{
+		if (blocks[block].allocation == allocation)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+VkBuffer BufferArena::replaceBuffer(VmaAllocation allocation, VkBuffer buffer, uint32_t& block)
+{
+	for (block = 0u; block < uint32_t(blocks.size()); block++)
+	{
+		if (blocks[block].allocation == allocation)
+		{
+			VkBuffer oldBuffer = blocks[block].buffer;
+			blocks[block].buffer = buffer;
+			return oldBuffer;
+		}
+	}
+	return VK_NULL_HANDLE;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//アリーナから切り出した配列。blockのバッファのoffsetからrangeバイトを使う。
+//blockとallocationは解放に使うので書き換えないこと。
+//ブロックのバッファはデフラグで移ると替わるので持たせない。結び付ける時にBufferArena::blockBufferで引く。
+struct ArenaRange
+{
+	VkDeviceSize offset;
+	VkDeviceSize range;
+	uint32_t block;
+	VmaVirtualAllocation allocation;
+};
+
+//小さな配列をそれぞれ別のVkBufferとメモリで持つ代わりに、大きなVkBufferをVMAの仮想ブロックで切り分けて配る。
+//オフセットはalignmentに揃えるので、minStorageBufferOffsetAlignmentを渡せばダイナミックオフセットでそのまま結び付けられる。
+//ブロックのバッファはblockSize + rangeLimitの大きさで作り、どのオフセットからでもrangeLimitの範囲のデスクリプタが収まるようにする。
+class BufferArena
+{
+public:
+	BufferArena();
+	//queueFamilyIndicesが2つ以上ならバッファをCONCURRENTで作り、キューの間で持ち主を移さずに使えるようにする。
+	//poolを渡せばブロックのメモリはそのプールから取る。
+	void create(VmaAllocator allocator, VmaPool pool, VkDeviceSize blockSize, VkDeviceSize rangeLimit, VkDeviceSize alignment, VkBufferUsageFlags usage, const vector<uint32_t>& queueFamilyIndices, vector<const char*>& errors);
+	void destroy();
+	//rangeLimitより大きな配列は切り出せない。空きが無ければブロックを足す。
+	bool allocate(VkDeviceSize size, ArenaRange& range);
+	//範囲を使うサブミットが完了してから呼ぶこと
+	void free(ArenaRange& range);
+	uint32_t blockCount() const;
+	VkBuffer blockBuffer(uint32_t block) const;
+	//切り出したままで、まだfreeしていない配列ならtrue
+	bool valid(const ArenaRange& range) const;
+	VkDeviceSize rangeLimit() const;
+	//ブロックのバッファの大きさ。blockSize + rangeLimit。
+	VkDeviceSize blockBufferSize() const;
+	//今切り出されている配列の数とその合計の大きさ
+	uint32_t rangeCount() const;
+	VkDeviceSize usedBytes() const;
+	//デフラグでallocationがdstAllocationへ移されるなら、移し先に同じ作りのバッファを作ってコピーの範囲を返す。
+	//allocationがこのアリーナのブロックでなければfalseを返す。
+	bool createMovedBuffer(VmaAllocation allocation, VmaAllocation dstAllocation, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size);
+	//allocationがこのアリーナのブロックならその番号を返す
+	bool findBlock(VmaAllocation allocation, uint32_t& block) const;
+	//コピーを終えたブロックのバッファを差し替えて、古いバッファと差し替えたブロックを返す
+	VkBuffer replaceBuffer(VmaAllocation allocation, VkBuffer buffer, uint32_t& block);
+private:
+	struct Block
+	{
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		VmaVirtualBlock virtualBlock;
+	};
+	VmaAllocator allocator;
+	VmaPool pool;
+	vector<const char*>* errors;
+	VkDeviceSize blockSize;
+	VkDeviceSize limit;
+	VkDeviceSize alignment;
+	VkBufferUsageFlags usage;
+	vector<uint32_t> queueFamilyIndices;
+	vector<Block> blocks;
+	uint32_t ranges;
+	VkDeviceSize used;
+	VkBufferCreateInfo blockBufferCreateInfo() const;
+	bool createBlock();
+};
@@ -0,0 +1,111 @@
+#include "capabilities.h"
+#include <cstring>
+#include <cstddef>
+
+VulkanCapabilities::VulkanCapabilities()
+{
+	requiredFeatures = {};
+	optionalFeatures = {};
+	requiredFeatures11 = {};
+	requiredFeatures11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	optionalFeatures11 = {};
+	optionalFeatures11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	requiredFeatures12 = {};
+	requiredFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	optionalFeatures12 = {};
+	optionalFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	enableValidation = false;
+	enableAllExtensions = false;
+	deviceOverride = nullptr;
+}
+
+EnabledCapabilities::EnabledCapabilities()
+{
+	features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features11 = {};
+	features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	link();
+}
+
+//コピーされるとpNextが元を指したままになるので繋ぎ直す
+void EnabledCapabilities::link()
+{
+	features.pNext = &features11;
+	features11.pNext = &features12;
+	features12.pNext = nullptr;
+}
+
+static bool containsName(const vector<const char*>& names, const char* name)
+{
+	for (const auto* v : names)
+	{
+		if (strcmp(v, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool EnabledCapabilities::hasInstanceExtension(const char* name) const
+{
+	return containsName(instanceExtensions, name);
+}
+
+bool EnabledCapabilities::hasDeviceExtension(const char* name) const
+{
+	return containsName(deviceExtensions, name);
+}
+
+bool mergeFeatures(const VkBool32* required, const VkBool32* optional, const VkBool32* supported, VkBool32* enabled, size_t count)
+{
+	bool satisfied = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (required[i] && !supported[i])
+		{
+			satisfied = false;
+		}
+		enabled[i] = (required[i] || optional[i]) && supported[i] ? VK_TRUE : VK_FALSE;
+	}
+	return satisfied;
+}
+
+bool selectExtensions(const vector<VkExtensionProperties>& available, const vector<const char*>& required, const vector<const char*>& optional, vector<const char*>& enabled)
+{
+	auto isAvailable = [&](const char* name)
+	{
+		for (const auto& v : available)
+		{
+			if (strcmp(v.extensionName, name) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	bool satisfied = true;
+	for (const auto* name : required)
+	{
+		if (!isAvailable(name))
+		{
+			satisfied = false;
+		}
+		else if (!containsName(enabled, name))
+		{
+			enabled.push_back(name);
+		}
+	}
+	for (const auto* name : optional)
+	{
+		if (isAvailable(name) && !containsName(enabled, name))
+		{
+			enabled.push_back(name);
+		}
+	}
+	return satisfied;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+using namespace std;
+
+//アプリケーションが要求するインスタンス/デバイスの拡張と機能。
+//requiredが満たせなければ初期化エラーになり、optionalは対応していれば有効にする。
+struct VulkanCapabilities
+{
+	VulkanCapabilities();
+	vector<const char*> requiredInstanceExtensions;
+	vector<const char*> optionalInstanceExtensions;
+	vector<const char*> requiredDeviceExtensions;
+	vector<const char*> optionalDeviceExtensions;
+	VkPhysicalDeviceFeatures requiredFeatures;
+	VkPhysicalDeviceFeatures optionalFeatures;
+	VkPhysicalDeviceVulkan11Features requiredFeatures11;
+	VkPhysicalDeviceVulkan11Features optionalFeatures11;
+	VkPhysicalDeviceVulkan12Features requiredFeatures12;
+	VkPhysicalDeviceVulkan12Features optionalFeatures12;
+	//VK_LAYER_KHRONOS_validationとVK_EXT_debug_utilsのメッセンジャーを有効にする
+	bool enableValidation;
+	//比較計測用。対応している拡張を全て有効にする従来の挙動に戻す
+	bool enableAllExtensions;
+	//デバイス名の一部かdeviceUUIDを指定すると、スコアに関係なくそのデバイスを使う
+	const char* deviceOverride;
+};
+
+//有効にした拡張と機能。createDeviceのpNextにそのまま繋げられる。
+struct EnabledCapabilities
+{
+	EnabledCapabilities();
+	vector<const char*> instanceExtensions;
+	vector<const char*> deviceExtensions;
+	//enableAllExtensionsで有効にした拡張名はここを指すので、破棄せずに持っておく
+	vector<VkExtensionProperties> availableInstanceExtensions;
+	vector<VkExtensionProperties> availableDeviceExtensions;
+	VkPhysicalDeviceFeatures2 features;
+	VkPhysicalDeviceVulkan11Features features11;
+	VkPhysicalDeviceVulkan12Features features12;
+	bool hasInstanceExtension(const char* name) const;
+	bool hasDeviceExtension(const char* name) const;
+	void link();
+};
+
+//VkBool32だけが並ぶ機能構造体をまとめて扱う。supportedに無いrequiredがあればfalseを返す。
+bool mergeFeatures(const VkBool32* required, const VkBool32* optional, const VkBool32* supported, VkBool32* enabled, size_t count);
+
+//拡張名の一覧から要求された拡張を選ぶ。availableに無いrequiredがあればfalseを返す。
+bool selectExtensions(const vector<VkExtensionProperties>& available, const vector<const char*>& required, const vector<const char*>& optional, vector<const char*>& enabled);
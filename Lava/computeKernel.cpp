@@ -0,0 +1,184 @@
+#include "computeKernel.h"
+
+ComputeKernel::ComputeKernel()
+{
+	localSizeX = 8u;
+	localSizeY = 4u;
+	maxGroupCountX = 65535u;
+	device = VK_NULL_HANDLE;
+	pipelineLayout = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	pushConstantSize = 0u;
+	updateTemplate = VK_NULL_HANDLE;
+	usePushDescriptor = false;
+	pfnCmdPushDescriptorSetWithTemplate = nullptr;
+}
+
+void ComputeKernel::create(VkDevice device, VkShaderModule shaderModule, const ShaderInterface& shaderInterface, VkPipelineLayout pipelineLayout, float value, VkPipelineCache pipelineCache, vector<const char*>& errors)
+{
+	this->device = device;
+	this->pipelineLayout = pipelineLayout;
+	localSizeX = shaderInterface.localSize[0];
+	localSizeY = shaderInterface.localSize[1];
+	pushConstantSize = shaderInterface.pushConstantSize;
+	createPipeline(shaderModule, shaderInterface, value, pipelineCache, errors);
+}
+
+void ComputeKernel::createPipeline(VkShaderModule shaderModule, const ShaderInterface& shaderInterface, float value, VkPipelineCache pipelineCache, vector<const char*>& errors)
+{
+	//constant_id = 3 に値を流し込む。シェーダーが宣言していなければ渡さない。
+	VkSpecializationMapEntry specializationMapEntry{};
+	specializationMapEntry.constantID = 3u;
+	specializationMapEntry.offset = 0u;
+	specializationMapEntry.size = sizeof(float);
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = 1u;
+	specializationInfo.pMapEntries = &specializationMapEntry;
+	specializationInfo.dataSize = sizeof(float);
+	specializationInfo.pData = &value;
+
+	VkPipelineShaderStageCreateInfo shaderStageCI{};
+	shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStageCI.pNext = nullptr;
+	shaderStageCI.flags = 0u;
+	shaderStageCI.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	shaderStageCI.module = shaderModule;
+	shaderStageCI.pName = "main";
+	shaderStageCI.pSpecializationInfo = shaderInterface.hasSpecConstant(3u) ? &specializationInfo : nullptr;
+
+	VkComputePipelineCreateInfo computePipelineCI{};
+	computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCI.pNext = nullptr;
+	computePipelineCI.flags = 0u;
+	computePipelineCI.stage = shaderStageCI;
+	computePipelineCI.layout = pipelineLayout;
+	computePipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+	computePipelineCI.basePipelineIndex = -1;
+	if (vkCreateComputePipelines(device, pipelineCache, 1u, &computePipelineCI, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateComputePipelines is failed in createPipeline");
+	}
+}
+
+void ComputeKernel::createUpdateTemplate(const ShaderInterface& shaderInterface, VkDescriptorSetLayout descriptorSetLayout, bool pushDescriptor, vector<const char*>& errors)
+{
+	//bindingごとにbufferInfosの続きを読ませる
+	vector<VkDescriptorUpdateTemplateEntry> entries;
+	size_t infoCount = 0u;
+	for (const auto& binding : shaderInterface.bindings)
+	{
+		if (binding.set != 0u)
+		{
+			continue;
+		}
+		if (binding.descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && binding.descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		{
+			errors.push_back("binding other than storage or uniform buffer is not supported in createUpdateTemplate");
+			return;
+		}
+		VkDescriptorUpdateTemplateEntry entry{};
+		entry.dstBinding = binding.binding;
+		entry.dstArrayElement = 0u;
+		entry.descriptorCount = binding.count != 0u ? binding.count : 1u;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = infoCount * sizeof(VkDescriptorBufferInfo);
+		entry.stride = sizeof(VkDescriptorBufferInfo);
+		entries.push_back(entry);
+		infoCount += entry.descriptorCount;
+	}
+
+	if (pushDescriptor)
+	{
+		pfnCmdPushDescriptorSetWithTemplate = reinterpret_cast<PFN_vkCmdPushDescriptorSetWithTemplateKHR>(vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR"));
+		if (pfnCmdPushDescriptorSetWithTemplate == nullptr)
+		{
+			errors.push_back("vkCmdPushDescriptorSetWithTemplateKHR is not available in createUpdateTemplate");
+			return;
+		}
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo descriptorUpdateTemplateCI{};
+	descriptorUpdateTemplateCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	descriptorUpdateTemplateCI.pNext = nullptr;
+	descriptorUpdateTemplateCI.flags = 0u;
+	descriptorUpdateTemplateCI.descriptorUpdateEntryCount = uint32_t(entries.size());
+	descriptorUpdateTemplateCI.pDescriptorUpdateEntries = entries.data();
+	descriptorUpdateTemplateCI.templateType = pushDescriptor ? VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR : VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	descriptorUpdateTemplateCI.descriptorSetLayout = descriptorSetLayout;
+	descriptorUpdateTemplateCI.pipelineBindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
+	descriptorUpdateTemplateCI.pipelineLayout = pipelineLayout;
+	descriptorUpdateTemplateCI.set = 0u;
+	if (vkCreateDescriptorUpdateTemplate(device, &descriptorUpdateTemplateCI, nullptr, &updateTemplate) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateDescriptorUpdateTemplate is failed in createUpdateTemplate");
+		return;
+	}
+	usePushDescriptor = pushDescriptor;
+}
+
+//セットを使わず、記録中のコマンドバッファにset 0の内容を直接積む
+void ComputeKernel::push(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo* bufferInfos)
+{
+	pfnCmdPushDescriptorSetWithTemplate(commandBuffer, updateTemplate, pipelineLayout, 0u, bufferInfos);
+}
+
+//VkWriteDescriptorSetを組み立てずにテンプレートでセットを書く。GPUが使っているセットには書かないこと。
+void ComputeKernel::write(VkDescriptorSet descriptorSet, const VkDescriptorBufferInfo* bufferInfos)
+{
+	vkUpdateDescriptorSetWithTemplate(device, descriptorSet, updateTemplate, bufferInfos);
+}
+
+void ComputeKernel::pushConstants(VkCommandBuffer commandBuffer, const void* data)
+{
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0u, pushConstantSize, data);
+}
+
+bool ComputeKernel::pushDescriptor() const
+{
+	return usePushDescriptor;
+}
+
+uint32_t ComputeKernel::groupInvocationCount() const
+{
+	return localSizeX * localSizeY;
+}
+
+//記録中のコマンドバッファにディスパッチを積む。
+//縦に折り返すと最後の行の余りの分だけelementCountより多く起動するので、シェーダーはpush_constantの要素数で範囲外を捨てること。
+void ComputeKernel::dispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, uint32_t elementCount, uint32_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+{
+	//index = x + y * width なので、グループを横に並べ、溢れた分は縦に折り返しても添字は連続する。
+	const uint32_t groupCount = (elementCount + groupInvocationCount() - 1u) / groupInvocationCount();
+	uint32_t groupCountX = groupCount;
+	uint32_t groupCountY = 1u;
+	if (groupCount > maxGroupCountX)
+	{
+		groupCountX = maxGroupCountX;
+		groupCountY = (groupCount + maxGroupCountX - 1u) / maxGroupCountX;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	if (descriptorSet != VK_NULL_HANDLE)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0u, 1u, &descriptorSet, dynamicOffsetCount, dynamicOffsets);
+	}
+	vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1u);
+}
+
+void ComputeKernel::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	if (updateTemplate != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorUpdateTemplate(device, updateTemplate, nullptr);
+		updateTemplate = VK_NULL_HANDLE;
+	}
+	vkDestroyPipeline(device, pipeline, nullptr);
+	pipeline = VK_NULL_HANDLE;
+	usePushDescriptor = false;
+	pipelineLayout = VK_NULL_HANDLE;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "spirvReflection.h"
+
+using namespace std;
+
+//SPIR-Vのコンピュートシェーダーを実行するためのパイプライン一式。
+//パイプラインレイアウトはLayoutCacheが持ち、同じ取り決めのカーネルと共有する。
+class ComputeKernel
+{
+public:
+	ComputeKernel();
+	void create(VkDevice device, VkShaderModule shaderModule, const ShaderInterface& shaderInterface, VkPipelineLayout pipelineLayout, float value, VkPipelineCache pipelineCache, vector<const char*>& errors);
+	//set 0のバッファをVkDescriptorBufferInfoの配列から書くテンプレートを作る。
+	//pushDescriptorならpipelineLayoutのset 0はpush descriptorのレイアウトでなければならない。
+	void createUpdateTemplate(const ShaderInterface& shaderInterface, VkDescriptorSetLayout descriptorSetLayout, bool pushDescriptor, vector<const char*>& errors);
+	void destroy();
+	//bufferInfosはset 0のbindingの順に、配列なら要素の数だけ並べる
+	void push(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo* bufferInfos);
+	void write(VkDescriptorSet descriptorSet, const VkDescriptorBufferInfo* bufferInfos);
+	//シェーダーのpush_constantの大きさだけdataから積む
+	void pushConstants(VkCommandBuffer commandBuffer, const void* data);
+	//pushで積んだ時やセットを使わないカーネルではdescriptorSetにVK_NULL_HANDLEを渡す。
+	//セットにダイナミックなbindingがあれば、その数だけdynamicOffsetsを渡す。
+	void dispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, uint32_t elementCount, uint32_t dynamicOffsetCount = 0u, const uint32_t* dynamicOffsets = nullptr);
+	bool pushDescriptor() const;
+	uint32_t groupInvocationCount() const;
+	//createでシェーダーのlocal_size_x, local_size_yから設定する。
+	uint32_t localSizeX;
+	uint32_t localSizeY;
+	//1次元のディスパッチ数がこれを超えるとY方向に折り返す。
+	uint32_t maxGroupCountX;
+private:
+	VkDevice device;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	uint32_t pushConstantSize;
+	VkDescriptorUpdateTemplate updateTemplate;
+	bool usePushDescriptor;
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR pfnCmdPushDescriptorSetWithTemplate;
+	void createPipeline(VkShaderModule shaderModule, const ShaderInterface& shaderInterface, float value, VkPipelineCache pipelineCache, vector<const char*>& errors);
+};
@@ -0,0 +1,96 @@
+#include "defragmenter.h"
+
+Defragmenter::Defragmenter()
+{
+	allocator = VK_NULL_HANDLE;
+	pool = VK_NULL_HANDLE;
+	maxBytesPerPass = 0u;
+	maxAllocationsPerPass = 0u;
+	context = VK_NULL_HANDLE;
+	total = {};
+	passes = 0u;
+}
+
+void Defragmenter::create(VmaAllocator allocator, VmaPool pool, VkDeviceSize maxBytesPerPass, uint32_t maxAllocationsPerPass)
+{
+	this->allocator = allocator;
+	this->pool = pool;
+	this->maxBytesPerPass = maxBytesPerPass;
+	this->maxAllocationsPerPass = maxAllocationsPerPass;
+}
+
+//途中のデフラグがあれば、そこまでの移動を確定させて終える
+void Defragmenter::destroy()
+{
+	if (context != VK_NULL_HANDLE)
+	{
+		finish();
+	}
+	allocator = VK_NULL_HANDLE;
+}
+
+bool Defragmenter::beginPass(VmaDefragmentationPassMoveInfo& passInfo)
+{
+	passInfo = {};
+	if (allocator == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	if (context == VK_NULL_HANDLE)
+	{
+		VmaDefragmentationInfo defragmentationInfo{};
+		defragmentationInfo.flags = 0u;
+		defragmentationInfo.pool = pool;
+		defragmentationInfo.maxBytesPerPass = maxBytesPerPass;
+		defragmentationInfo.maxAllocationsPerPass = maxAllocationsPerPass;
+		if (vmaBeginDefragmentation(allocator, &defragmentationInfo, &context) != VK_SUCCESS)
+		{
+			context = VK_NULL_HANDLE;
+			return false;
+		}
+	}
+	//VK_SUCCESSなら動かすものは残っていない
+	if (vmaBeginDefragmentationPass(allocator, context, &passInfo) != VK_INCOMPLETE)
+	{
+		finish();
+		return false;
+	}
+	return true;
+}
+
+bool Defragmenter::endPass(VmaDefragmentationPassMoveInfo& passInfo)
+{
+	passes++;
+	if (vmaEndDefragmentationPass(allocator, context, &passInfo) == VK_INCOMPLETE)
+	{
+		return false;
+	}
+	finish();
+	return true;
+}
+
+void Defragmenter::finish()
+{
+	VmaDefragmentationStats defragmentationStats{};
+	vmaEndDefragmentation(allocator, context, &defragmentationStats);
+	context = VK_NULL_HANDLE;
+	total.bytesMoved += defragmentationStats.bytesMoved;
+	total.bytesFreed += defragmentationStats.bytesFreed;
+	total.allocationsMoved += defragmentationStats.allocationsMoved;
+	total.deviceMemoryBlocksFreed += defragmentationStats.deviceMemoryBlocksFreed;
+}
+
+bool Defragmenter::active() const
+{
+	return context != VK_NULL_HANDLE;
+}
+
+const VmaDefragmentationStats& Defragmenter::stats() const
+{
+	return total;
+}
+
+uint64_t Defragmenter::passCount() const
+{
+	return passes;
+}
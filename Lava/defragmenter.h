@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//VMAのデフラグをパスごとに進める。1回のパスで動かす量はmaxBytesPerPassとmaxAllocationsPerPassで抑える。
+//beginPassが返した移動のコピーを記録し、完了を待ってからendPassを呼ぶ。
+//移すバッファの作り直しと、それを指していたデスクリプタの差し替えは呼び出し側が行う。
+class Defragmenter
+{
+public:
+	Defragmenter();
+	//poolがVK_NULL_HANDLEなら既定のプールを詰める
+	void create(VmaAllocator allocator, VmaPool pool, VkDeviceSize maxBytesPerPass, uint32_t maxAllocationsPerPass);
+	void destroy();
+	//デフラグが始まっていなければ始める。動かすものがあればtrueを返し、無ければデフラグを終えてfalseを返す。
+	bool beginPass(VmaDefragmentationPassMoveInfo& passInfo);
+	//パスを終える。デフラグが最後まで済んだらtrueを返す。
+	bool endPass(VmaDefragmentationPassMoveInfo& passInfo);
+	bool active() const;
+	//今までに終えたデフラグの合計
+	const VmaDefragmentationStats& stats() const;
+	uint64_t passCount() const;
+private:
+	VmaAllocator allocator;
+	VmaPool pool;
+	VkDeviceSize maxBytesPerPass;
+	uint32_t maxAllocationsPerPass;
+	VmaDefragmentationContext context;
+	VmaDefragmentationStats total;
+	uint64_t passes;
+	void finish();
+};
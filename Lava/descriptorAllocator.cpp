@@ -0,0 +1,164 @@
+#include "descriptorAllocator.h"
+
+//プールは使い切るたびに倍の大きさで作り、ここで頭打ちにする
+static const uint32_t MaxSetsPerPool = 4096u;
+
+DescriptorAllocator::DescriptorAllocator()
+{
+	device = VK_NULL_HANDLE;
+	errors = nullptr;
+	nextPoolSets = 0u;
+	currentPool = VK_NULL_HANDLE;
+	poolTotal = 0u;
+	//計算用途なのでストレージバッファを多めに、残りの種類も一通り入れておく
+	ratios = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1u },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1u },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1u },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1u },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1u },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1u },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2u },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4u },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1u },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1u },
+	};
+}
+
+//setsPerPoolは最初のプールのセット数。ratiosはこれより前に変えておくこと。
+void DescriptorAllocator::create(VkDevice device, uint32_t setsPerPool, vector<const char*>& errors)
+{
+	this->device = device;
+	this->errors = &errors;
+	nextPoolSets = setsPerPool != 0u ? setsPerPool : 1u;
+}
+
+void DescriptorAllocator::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//プールを破棄すればそこから切り出したセットも全て無くなる
+	reset();
+	for (auto pool : freePools)
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	freePools.clear();
+	poolTotal = 0u;
+	device = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+{
+	vector<VkDescriptorPoolSize> poolSizes = ratios;
+	for (auto& poolSize : poolSizes)
+	{
+		poolSize.descriptorCount *= setCount;
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolCI{};
+	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCI.pNext = nullptr;
+	descriptorPoolCI.flags = 0u;
+	descriptorPoolCI.maxSets = setCount;
+	descriptorPoolCI.poolSizeCount = uint32_t(poolSizes.size());
+	descriptorPoolCI.pPoolSizes = poolSizes.data();
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &pool) != VK_SUCCESS)
+	{
+		errors->push_back("vkCreateDescriptorPool is failed in DescriptorAllocator::createPool");
+		return VK_NULL_HANDLE;
+	}
+	poolTotal++;
+	return pool;
+}
+
+//空いているプールがあればそれを、無ければ前より大きなプールを作る
+VkDescriptorPool DescriptorAllocator::acquirePool()
+{
+	if (!freePools.empty())
+	{
+		VkDescriptorPool pool = freePools.back();
+		freePools.pop_back();
+		return pool;
+	}
+	VkDescriptorPool pool = createPool(nextPoolSets);
+	nextPoolSets = nextPoolSets * 2u < MaxSetsPerPool ? nextPoolSets * 2u : MaxSetsPerPool;
+	return pool;
+}
+
+bool DescriptorAllocator::allocate(VkDescriptorSetLayout layout, VkDescriptorSet& descriptorSet)
+{
+	if (currentPool == VK_NULL_HANDLE)
+	{
+		currentPool = acquirePool();
+	}
+	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocInfo.pNext = nullptr;
+	descriptorSetAllocInfo.descriptorPool = currentPool;
+	descriptorSetAllocInfo.descriptorSetCount = 1u;
+	descriptorSetAllocInfo.pSetLayouts = &layout;
+	VkResult result = currentPool != VK_NULL_HANDLE ? vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet) : VK_ERROR_OUT_OF_POOL_MEMORY;
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		//このプールは使い切ったので、次のプールで取り直す
+		if (currentPool != VK_NULL_HANDLE)
+		{
+			usedPools.push_back(currentPool);
+		}
+		currentPool = acquirePool();
+		descriptorSetAllocInfo.descriptorPool = currentPool;
+		result = currentPool != VK_NULL_HANDLE ? vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet) : VK_ERROR_OUT_OF_POOL_MEMORY;
+	}
+	if (result != VK_SUCCESS)
+	{
+		errors->push_back("vkAllocateDescriptorSets is failled in DescriptorAllocator::allocate");
+		descriptorSet = VK_NULL_HANDLE;
+		return false;
+	}
+	return true;
+}
+
+//使いかけのプールは手放さず、使い切った時に次のretireの値で手放す。
+//値は単調に増えるので、そのプールの全てのセットはその値までに使い終わる。
+void DescriptorAllocator::retire(uint64_t value)
+{
+	for (auto pool : usedPools)
+	{
+		retiredPools.push_back({ pool, value });
+	}
+	usedPools.clear();
+}
+
+void DescriptorAllocator::reclaim(uint64_t completedValue)
+{
+	while (!retiredPools.empty() && retiredPools.front().value <= completedValue)
+	{
+		vkResetDescriptorPool(device, retiredPools.front().pool, 0u);
+		freePools.push_back(retiredPools.front().pool);
+		retiredPools.pop_front();
+	}
+}
+
+void DescriptorAllocator::reset()
+{
+	if (currentPool != VK_NULL_HANDLE)
+	{
+		usedPools.push_back(currentPool);
+		currentPool = VK_NULL_HANDLE;
+	}
+	retire(0u);
+	for (auto& retired : retiredPools)
+	{
+		vkResetDescriptorPool(device, retired.pool, 0u);
+		freePools.push_back(retired.pool);
+	}
+	retiredPools.clear();
+}
+
+uint32_t DescriptorAllocator::poolCount() const
+{
+	return poolTotal;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+
+using namespace std;
+
+//デスクリプタプールを必要なだけ増やしながらセットを切り出す。
+//セットを1つずつ解放せず(FREE_DESCRIPTOR_SET_BITを使わず)、プールごとまとめてリセットする。
+//使い終わったセットはretireでサブミットの値に結び付け、reclaimでその値の完了を知らされたプールから使い回す。
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator();
+	void create(VkDevice device, uint32_t setsPerPool, vector<const char*>& errors);
+	void destroy();
+	bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet& descriptorSet);
+	//今までに切り出したセットを使うサブミットの値。使い切ったプールはreclaimされるまで使わない。
+	//同じallocatorには1つのタイムラインの値だけを渡すこと。
+	void retire(uint64_t value);
+	void reclaim(uint64_t completedValue);
+	//GPUがどのセットも使っていない時に、全てのプールをまとめて空ける
+	void reset();
+	uint32_t poolCount() const;
+	//1つのプールで1セットあたりに用意する各種デスクリプタの数。全ての種類を同じプールに入れる。
+	vector<VkDescriptorPoolSize> ratios;
+private:
+	struct RetiredPool
+	{
+		VkDescriptorPool pool;
+		uint64_t value;
+	};
+	VkDevice device;
+	vector<const char*>* errors;
+	uint32_t nextPoolSets;
+	VkDescriptorPool currentPool;
+	vector<VkDescriptorPool> usedPools;
+	vector<VkDescriptorPool> freePools;
+	deque<RetiredPool> retiredPools;
+	uint32_t poolTotal;
+	VkDescriptorPool acquirePool();
+	VkDescriptorPool createPool(uint32_t setCount);
+};
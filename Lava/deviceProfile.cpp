@@ -0,0 +1,242 @@
+#include "deviceProfile.h"
+#include <cstring>
+#include <cctype>
+
+DeviceProfile::DeviceProfile()
+{
+	physicalDevice = VK_NULL_HANDLE;
+	properties = {};
+	properties11 = {};
+	properties11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+	properties12 = {};
+	properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	memoryProperties = {};
+	features = {};
+	features11 = {};
+	features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+}
+
+void queryDeviceProfile(VkPhysicalDevice physicalDevice, DeviceProfile& profile)
+{
+	profile.physicalDevice = physicalDevice;
+	vkGetPhysicalDeviceProperties(physicalDevice, &profile.properties);
+
+	//1.1/1.2の構造体はデバイスがそのバージョンに対応している場合にだけ繋げられる
+	const bool vulkan11 = profile.properties.apiVersion >= VK_API_VERSION_1_1;
+	const bool vulkan12 = profile.properties.apiVersion >= VK_API_VERSION_1_2;
+	if (vulkan11)
+	{
+		VkPhysicalDeviceProperties2 props{};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &profile.properties11;
+		profile.properties11.pNext = vulkan12 ? &profile.properties12 : nullptr;
+		profile.properties12.pNext = nullptr;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &profile.features11;
+		profile.features11.pNext = vulkan12 ? &profile.features12 : nullptr;
+		profile.features12.pNext = nullptr;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		profile.features = features.features;
+
+		//保持する構造体が一時変数を指したままにならないよう切り離す
+		profile.properties11.pNext = nullptr;
+		profile.features11.pNext = nullptr;
+	}
+	else
+	{
+		vkGetPhysicalDeviceFeatures(physicalDevice, &profile.features);
+	}
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &profile.memoryProperties);
+
+	uint32_t queueFamilyCount = 0u;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	profile.queueFamilies.resize(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, profile.queueFamilies.data());
+}
+
+const VkPhysicalDeviceLimits& DeviceProfile::limits() const
+{
+	return properties.limits;
+}
+
+uint32_t DeviceProfile::subgroupSize() const
+{
+	return properties11.subgroupSize;
+}
+
+bool DeviceProfile::supportsSubgroupOperations(VkSubgroupFeatureFlags operations) const
+{
+	return (properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(properties11.subgroupSupportedOperations & operations) == operations;
+}
+
+bool DeviceProfile::supportsCompute() const
+{
+	for (const auto& v : queueFamilies)
+	{
+		if (v.queueFlags & VK_QUEUE_COMPUTE_BIT)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DeviceProfile::supportsVulkan12() const
+{
+	return properties.apiVersion >= VK_API_VERSION_1_2;
+}
+
+bool DeviceProfile::supportsFloat16() const
+{
+	return features12.shaderFloat16 == VK_TRUE;
+}
+
+bool DeviceProfile::supportsFloat64() const
+{
+	return features.shaderFloat64 == VK_TRUE;
+}
+
+bool DeviceProfile::supportsInt16() const
+{
+	return features.shaderInt16 == VK_TRUE;
+}
+
+bool DeviceProfile::supportsInt64() const
+{
+	return features.shaderInt64 == VK_TRUE;
+}
+
+bool DeviceProfile::supportsStorageBuffer16BitAccess() const
+{
+	return features11.storageBuffer16BitAccess == VK_TRUE;
+}
+
+VkDeviceSize DeviceProfile::deviceLocalHeapSize() const
+{
+	VkDeviceSize size = 0u;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			size += memoryProperties.memoryHeaps[i].size;
+		}
+	}
+	return size;
+}
+
+VkDeviceSize DeviceProfile::hostVisibleDeviceLocalHeapSize() const
+{
+	const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	VkDeviceSize size = 0u;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		const VkMemoryType& memoryType = memoryProperties.memoryTypes[i];
+		if ((memoryType.propertyFlags & flags) == flags && memoryProperties.memoryHeaps[memoryType.heapIndex].size > size)
+		{
+			size = memoryProperties.memoryHeaps[memoryType.heapIndex].size;
+		}
+	}
+	return size;
+}
+
+bool DeviceProfile::prefersZeroCopy() const
+{
+	const VkDeviceSize heapSize = hostVisibleDeviceLocalHeapSize();
+	if (heapSize == 0u)
+	{
+		return false;
+	}
+	//統合GPUやCPU実装はVRAMとホストメモリが同じなので、コピーは丸ごと無駄になる
+	if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+	{
+		return true;
+	}
+	//ディスクリートGPUでは従来の256MiBのBAR窓は小さく取り合いになるので、Resizable BARの時だけ使う
+	return heapSize > (256u << 20);
+}
+
+uint64_t DeviceProfile::score() const
+{
+	//エンジンはVulkan 1.2の機能を前提にしている
+	if (!supportsVulkan12() || !supportsCompute())
+	{
+		return 0u;
+	}
+
+	uint64_t typeWeight = 1u;
+	switch (properties.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		typeWeight = 4u;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		typeWeight = 3u;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		typeWeight = 2u;
+		break;
+	default:
+		break;
+	}
+
+	//種類を最優先し、同じ種類の中ではVRAM容量と計算向けの上限で比べる
+	uint64_t score = typeWeight << 40;
+	score += (deviceLocalHeapSize() >> 20) << 8;
+	score += limits().maxComputeSharedMemorySize >> 10;
+	score += subgroupSize();
+	return score;
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	c = char(tolower(static_cast<unsigned char>(c)));
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+bool DeviceProfile::matches(const char* nameOrUUID) const
+{
+	if (nameOrUUID == nullptr || nameOrUUID[0] == '\0')
+	{
+		return false;
+	}
+
+	uint8_t uuid[VK_UUID_SIZE]{};
+	size_t digits = 0u;
+	bool isUUID = true;
+	for (const char* c = nameOrUUID; *c != '\0' && isUUID; c++)
+	{
+		if (*c == '-')
+		{
+			continue;
+		}
+		const int value = hexValue(*c);
+		if (value < 0 || digits >= VK_UUID_SIZE * 2u)
+		{
+			isUUID = false;
+			break;
+		}
+		uuid[digits / 2u] = uint8_t((uuid[digits / 2u] << 4) | value);
+		digits++;
+	}
+	if (isUUID && digits == VK_UUID_SIZE * 2u)
+	{
+		return memcmp(uuid, properties11.deviceUUID, VK_UUID_SIZE) == 0;
+	}
+
+	return strstr(properties.deviceName, nameOrUUID) != nullptr;
+}
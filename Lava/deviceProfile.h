@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+using namespace std;
+
+//物理デバイスの性能と機能を起動時に一度だけ問い合わせて保持する。
+//カーネルやアロケータはドライバーに問い合わせ直さずにここから高速な経路を選ぶ。
+struct DeviceProfile
+{
+	DeviceProfile();
+	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceVulkan11Properties properties11;
+	VkPhysicalDeviceVulkan12Properties properties12;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkPhysicalDeviceFeatures features;
+	VkPhysicalDeviceVulkan11Features features11;
+	VkPhysicalDeviceVulkan12Features features12;
+	vector<VkQueueFamilyProperties> queueFamilies;
+
+	const VkPhysicalDeviceLimits& limits() const;
+	uint32_t subgroupSize() const;
+	bool supportsSubgroupOperations(VkSubgroupFeatureFlags operations) const;
+	bool supportsCompute() const;
+	bool supportsVulkan12() const;
+	bool supportsFloat16() const;
+	bool supportsFloat64() const;
+	bool supportsInt16() const;
+	bool supportsInt64() const;
+	bool supportsStorageBuffer16BitAccess() const;
+	VkDeviceSize deviceLocalHeapSize() const;
+	//DEVICE_LOCALかつHOST_VISIBLEなメモリタイプを持つヒープのうち最大のもの
+	VkDeviceSize hostVisibleDeviceLocalHeapSize() const;
+	//ステージングを通さず、マップしたデバイスローカルメモリに直接書く方が速いか
+	bool prefersZeroCopy() const;
+	//計算用途での優先度。0は使用不可。
+	uint64_t score() const;
+	//名前の部分一致、またはハイフン有無を問わない32桁16進のdeviceUUIDと一致するか
+	bool matches(const char* nameOrUUID) const;
+};
+
+void queryDeviceProfile(VkPhysicalDevice physicalDevice, DeviceProfile& profile);
@@ -0,0 +1,162 @@
+#include "hostImport.h"
+
+HostImporter::HostImporter()
+{
+	device = VK_NULL_HANDLE;
+	memoryProperties = nullptr;
+	minImportedHostPointerAlignment = 0u;
+	pfnGetMemoryHostPointerProperties = nullptr;
+}
+
+void HostImporter::create(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, bool extensionEnabled)
+{
+	this->device = device;
+	this->memoryProperties = &memoryProperties;
+	if (!extensionEnabled)
+	{
+		return;
+	}
+	//拡張のプロパティは拡張が有効な時にしか繋げられないので、プロファイルとは別に問い合わせる
+	VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProps{};
+	hostProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+	hostProps.pNext = nullptr;
+	VkPhysicalDeviceProperties2 props{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &hostProps;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+	minImportedHostPointerAlignment = hostProps.minImportedHostPointerAlignment;
+	pfnGetMemoryHostPointerProperties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT"));
+}
+
+bool HostImporter::available() const
+{
+	return pfnGetMemoryHostPointerProperties != nullptr && minImportedHostPointerAlignment != 0u;
+}
+
+bool HostImporter::canImport(const void* pointer, VkDeviceSize size) const
+{
+	if (!available() || pointer == nullptr || size == 0u)
+	{
+		return false;
+	}
+	return reinterpret_cast<uintptr_t>(pointer) % minImportedHostPointerAlignment == 0u && size % minImportedHostPointerAlignment == 0u;
+}
+
+bool HostImporter::import(void* pointer, VkDeviceSize size, VkBufferUsageFlags usage, ImportedBuffer& importedBuffer, vector<const char*>& errors)
+{
+	importedBuffer = ImportedBuffer{};
+	if (!canImport(pointer, size))
+	{
+		return false;
+	}
+	VkMemoryHostPointerPropertiesEXT hostPointerProps{};
+	hostPointerProps.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	hostPointerProps.pNext = nullptr;
+	if (pfnGetMemoryHostPointerProperties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer, &hostPointerProps) != VK_SUCCESS)
+	{
+		errors.push_back("vkGetMemoryHostPointerPropertiesEXT is failed in HostImporter::import");
+		return false;
+	}
+
+	VkExternalMemoryBufferCreateInfo externalBufferCI{};
+	externalBufferCI.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	externalBufferCI.pNext = nullptr;
+	externalBufferCI.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = &externalBufferCI;
+	bufferCI.flags = 0;
+	bufferCI.size = size;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	if (vkCreateBuffer(device, &bufferCI, nullptr, &buffer) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateBuffer is failed in HostImporter::import");
+		return false;
+	}
+
+	//バッファが置けて、かつこのポインタを取り込めるメモリタイプを選ぶ。ホストから一貫して見えるものを優先する。
+	VkMemoryRequirements requirements{};
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	const uint32_t typeBits = requirements.memoryTypeBits & hostPointerProps.memoryTypeBits;
+	uint32_t memoryTypeIndex = UINT32_MAX;
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++)
+	{
+		if ((typeBits & (1u << i)) == 0u)
+		{
+			continue;
+		}
+		if (memoryTypeIndex == UINT32_MAX)
+		{
+			memoryTypeIndex = i;
+		}
+		if (memoryProperties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+		{
+			memoryTypeIndex = i;
+			break;
+		}
+	}
+	if (memoryTypeIndex == UINT32_MAX)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		return false;
+	}
+
+	VkImportMemoryHostPointerInfoEXT importInfo{};
+	importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	importInfo.pNext = nullptr;
+	importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	importInfo.pHostPointer = pointer;
+	//デバイスアドレスを取るバッファは、メモリの側にもその指定が要る
+	VkMemoryAllocateFlagsInfo memoryAllocFlagsInfo{};
+	memoryAllocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	memoryAllocFlagsInfo.pNext = nullptr;
+	memoryAllocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	memoryAllocFlagsInfo.deviceMask = 0u;
+	if ((usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0u)
+	{
+		importInfo.pNext = &memoryAllocFlagsInfo;
+	}
+	VkMemoryAllocateInfo memoryAllocInfo{};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.pNext = &importInfo;
+	memoryAllocInfo.allocationSize = size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	if (vkAllocateMemory(device, &memoryAllocInfo, nullptr, &memory) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		errors.push_back("vkAllocateMemory is failed in HostImporter::import");
+		return false;
+	}
+	if (vkBindBufferMemory(device, buffer, memory, 0u) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+		errors.push_back("vkBindBufferMemory is failed in HostImporter::import");
+		return false;
+	}
+	importedBuffer.buffer = buffer;
+	importedBuffer.memory = memory;
+	importedBuffer.size = size;
+	return true;
+}
+
+//GPUが使い終わってから呼ぶこと。ホストの配列自体は解放しない。
+void HostImporter::release(ImportedBuffer& importedBuffer)
+{
+	if (importedBuffer.buffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(device, importedBuffer.buffer, nullptr);
+		vkFreeMemory(device, importedBuffer.memory, nullptr);
+	}
+	importedBuffer = ImportedBuffer{};
+}
+
+VkDeviceSize HostImporter::alignment() const
+{
+	return minImportedHostPointerAlignment;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+using namespace std;
+
+//ホストのポインタをそのまま包んだバッファ。メモリの持ち主は呼び出し側のまま。
+struct ImportedBuffer
+{
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+};
+
+//VK_EXT_external_memory_hostで、ホストが確保済みの配列をコピーせずにGPUから見えるようにする。
+class HostImporter
+{
+public:
+	HostImporter();
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, bool extensionEnabled);
+	bool available() const;
+	//ポインタとサイズがminImportedHostPointerAlignmentに揃っていれば取り込める
+	bool canImport(const void* pointer, VkDeviceSize size) const;
+	bool import(void* pointer, VkDeviceSize size, VkBufferUsageFlags usage, ImportedBuffer& importedBuffer, vector<const char*>& errors);
+	void release(ImportedBuffer& importedBuffer);
+	VkDeviceSize alignment() const;
+private:
+	VkDevice device;
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	VkDeviceSize minImportedHostPointerAlignment;
+	PFN_vkGetMemoryHostPointerPropertiesEXT pfnGetMemoryHostPointerProperties;
+};
@@ -0,0 +1,189 @@
+#include "layoutCache.h"
+
+//FNV-1a。キーは数語しかないので十分速い。
+static uint64_t hashKey(const vector<uint64_t>& key)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (const auto word : key)
+	{
+		for (uint32_t i = 0; i < 8u; i++)
+		{
+			hash ^= (word >> (i * 8u)) & 0xffu;
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+//ハンドルは64ビットのポインタか整数のどちらかなので、どちらでもキーに入れられるようにする
+template<typename Handle>
+static uint64_t handleKey(Handle handle)
+{
+	return (uint64_t)(handle);
+}
+
+LayoutCache::LayoutCache()
+{
+	device = VK_NULL_HANDLE;
+	setLayoutTotal = 0u;
+	pipelineLayoutTotal = 0u;
+	hits = 0u;
+}
+
+void LayoutCache::create(VkDevice device)
+{
+	this->device = device;
+}
+
+void LayoutCache::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//パイプラインレイアウトが参照しているので、セットレイアウトは後で破棄する
+	for (auto& bucket : pipelineLayouts)
+	{
+		for (auto& entry : bucket.second)
+		{
+			vkDestroyPipelineLayout(device, entry.handle, nullptr);
+		}
+	}
+	for (auto& bucket : setLayouts)
+	{
+		for (auto& entry : bucket.second)
+		{
+			vkDestroyDescriptorSetLayout(device, entry.handle, nullptr);
+		}
+	}
+	pipelineLayouts.clear();
+	setLayouts.clear();
+	setLayoutTotal = 0u;
+	pipelineLayoutTotal = 0u;
+}
+
+VkDescriptorSetLayout LayoutCache::descriptorSetLayout(const ShaderInterface& shaderInterface, uint32_t set, vector<const char*>& errors, VkDescriptorSetLayoutCreateFlags flags)
+{
+	//bindingsはsetとbindingの順に並んでいるので、キーも同じ取り決めなら同じ並びになる
+	vector<VkDescriptorSetLayoutBinding> bindings;
+	vector<uint64_t> key;
+	key.push_back(uint64_t(flags));
+	for (const auto& binding : shaderInterface.bindings)
+	{
+		if (binding.set != set)
+		{
+			continue;
+		}
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding{};
+		descriptorSetLayoutBinding.binding = binding.binding;
+		descriptorSetLayoutBinding.descriptorType = binding.descriptorType;
+		//要素数を決めない配列は、今は1個として扱う
+		descriptorSetLayoutBinding.descriptorCount = binding.count != 0u ? binding.count : 1u;
+		descriptorSetLayoutBinding.stageFlags = shaderInterface.stage;
+		descriptorSetLayoutBinding.pImmutableSamplers = nullptr;
+		bindings.push_back(descriptorSetLayoutBinding);
+		key.push_back((uint64_t(descriptorSetLayoutBinding.binding) << 32) | uint64_t(descriptorSetLayoutBinding.descriptorType));
+		key.push_back((uint64_t(descriptorSetLayoutBinding.descriptorCount) << 32) | uint64_t(descriptorSetLayoutBinding.stageFlags));
+	}
+
+	vector<Entry<VkDescriptorSetLayout>>& bucket = setLayouts[hashKey(key)];
+	for (const auto& entry : bucket)
+	{
+		if (entry.key == key)
+		{
+			hits++;
+			return entry.handle;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+	descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCI.flags = flags;
+	descriptorSetLayoutCI.pNext = nullptr;
+	descriptorSetLayoutCI.bindingCount = uint32_t(bindings.size());
+	descriptorSetLayoutCI.pBindings = bindings.data();
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &layout) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateDescriptorSetLayout is failed in LayoutCache::descriptorSetLayout");
+		return VK_NULL_HANDLE;
+	}
+	bucket.push_back({ key, layout });
+	setLayoutTotal++;
+	return layout;
+}
+
+//setは0から順に全て並べ、push_constantがあれば先頭からその大きさの範囲を1つ取る
+VkPipelineLayout LayoutCache::pipelineLayout(const ShaderInterface& shaderInterface, vector<const char*>& errors, bool pushDescriptor)
+{
+	vector<VkDescriptorSetLayout> layouts;
+	for (uint32_t set = 0; set < shaderInterface.setCount(); set++)
+	{
+		//push descriptorで積めるのはパイプラインレイアウトの中で1つのsetだけ
+		const VkDescriptorSetLayoutCreateFlags flags = pushDescriptor && set == 0u ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0u;
+		const VkDescriptorSetLayout layout = descriptorSetLayout(shaderInterface, set, errors, flags);
+		if (layout == VK_NULL_HANDLE)
+		{
+			return VK_NULL_HANDLE;
+		}
+		layouts.push_back(layout);
+	}
+	return pipelineLayout(layouts, shaderInterface.stage, shaderInterface.pushConstantSize, errors);
+}
+
+VkPipelineLayout LayoutCache::pipelineLayout(const vector<VkDescriptorSetLayout>& setLayouts, VkShaderStageFlags stage, uint32_t pushConstantSize, vector<const char*>& errors)
+{
+	vector<uint64_t> key;
+	for (const auto layout : setLayouts)
+	{
+		key.push_back(handleKey(layout));
+	}
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = stage;
+	pushConstantRange.offset = 0u;
+	pushConstantRange.size = pushConstantSize;
+	key.push_back((uint64_t(pushConstantRange.size) << 32) | uint64_t(pushConstantRange.size != 0u ? pushConstantRange.stageFlags : 0u));
+
+	vector<Entry<VkPipelineLayout>>& bucket = pipelineLayouts[hashKey(key)];
+	for (const auto& entry : bucket)
+	{
+		if (entry.key == key)
+		{
+			hits++;
+			return entry.handle;
+		}
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCI.pNext = nullptr;
+	pipelineLayoutCI.flags = 0u;
+	pipelineLayoutCI.setLayoutCount = uint32_t(setLayouts.size());
+	pipelineLayoutCI.pSetLayouts = setLayouts.data();
+	pipelineLayoutCI.pushConstantRangeCount = pushConstantRange.size != 0u ? 1u : 0u;
+	pipelineLayoutCI.pPushConstantRanges = pushConstantRange.size != 0u ? &pushConstantRange : nullptr;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &layout) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreatePipelineLayout is failed in LayoutCache::pipelineLayout");
+		return VK_NULL_HANDLE;
+	}
+	bucket.push_back({ key, layout });
+	pipelineLayoutTotal++;
+	return layout;
+}
+
+uint32_t LayoutCache::setLayoutCount() const
+{
+	return setLayoutTotal;
+}
+
+uint32_t LayoutCache::pipelineLayoutCount() const
+{
+	return pipelineLayoutTotal;
+}
+
+uint64_t LayoutCache::hitCount() const
+{
+	return hits;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include "spirvReflection.h"
+
+using namespace std;
+
+//リフレクションの結果からデスクリプタセットレイアウトとパイプラインレイアウトを作り、内容のハッシュで使い回す。
+//同じ取り決めのカーネルは同じレイアウトを共有する。作ったレイアウトはdestroyまで持ち続ける。
+class LayoutCache
+{
+public:
+	LayoutCache();
+	void create(VkDevice device);
+	void destroy();
+	//shaderInterfaceのsetのレイアウト。bindingが無いsetは空のレイアウトになる。
+	//flagsが違えば別のレイアウトとして作る。
+	VkDescriptorSetLayout descriptorSetLayout(const ShaderInterface& shaderInterface, uint32_t set, vector<const char*>& errors, VkDescriptorSetLayoutCreateFlags flags = 0u);
+	//pushDescriptorならset 0をVK_KHR_push_descriptorで積むレイアウトにする
+	VkPipelineLayout pipelineLayout(const ShaderInterface& shaderInterface, vector<const char*>& errors, bool pushDescriptor = false);
+	//リフレクションからではなく、bindlessのセットのように外で作ったセットレイアウトを並べる
+	VkPipelineLayout pipelineLayout(const vector<VkDescriptorSetLayout>& setLayouts, VkShaderStageFlags stage, uint32_t pushConstantSize, vector<const char*>& errors);
+	uint32_t setLayoutCount() const;
+	uint32_t pipelineLayoutCount() const;
+	uint64_t hitCount() const;
+private:
+	//ハッシュが衝突しても取り違えないよう、キーそのものも持って比べる
+	template<typename Handle>
+	struct Entry
+	{
+		vector<uint64_t> key;
+		Handle handle;
+	};
+	VkDevice device;
+	unordered_map<uint64_t, vector<Entry<VkDescriptorSetLayout>>> setLayouts;
+	unordered_map<uint64_t, vector<Entry<VkPipelineLayout>>> pipelineLayouts;
+	uint32_t setLayoutTotal;
+	uint32_t pipelineLayoutTotal;
+	uint64_t hits;
+};
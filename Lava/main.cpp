@@ -1,8 +1,53 @@
 #include "vulkanBase.h"
 
 const int WindowWidth = 600, WindowHeight = 480;
-const char* AppTitle = "N̍";
+const char* AppTitle = "丑の刻怪奇譚";
 
+#if defined(LAVA_HEADLESS)
+//計算専用。ウィンドウを作らずにカーネルを1回流して終了する。
+int main()
+{
+	VulkanCapabilities capabilities;
+#ifdef _DEBUG
+	capabilities.enableValidation = true;
+#endif
+	VulkanBase vkBase;
+#if defined(LAVA_BENCHMARK)
+	//転送経路の比較用に大きめのバッファを取る
+	vkBase.deviceLocalBufferSize = 64u << 20;
+	//アドレスとbindlessは排他なので、bindlessを計るときはこちらをenableBindlessに替える
+	vkBase.enableBufferDeviceAddress = true;
+#endif
+	if (!vkBase.initialize(AppTitle, capabilities))
+	{
+		vkBase.terminate();
+		return 1;
+	}
+#if defined(LAVA_BENCHMARK)
+	vkBase.benchmarkUpload(vkBase.deviceLocalBufferSize, 32u);
+	vkBase.benchmarkDispatch(4096u);
+	vkBase.benchmarkScratch(1024u, 4096u);
+	vkBase.benchmarkDefragment(4096u);
+	//デバイスメモリに載せきらない大きさを想定し、チャンクに分けて流す
+	vector<float> streamInput(size_t(32u) << 20, 0.0f);
+	vector<float> streamOutput(streamInput.size());
+	vkBase.streamLog(vkBase.stream(streamInput.data(), streamOutput.data(), streamInput.size()));
+#endif
+	vector<float> input(256u, 0.0f);
+	vkBase.upload(input.data(), input.size() * sizeof(float));
+	vkBase.compute(uint32_t(input.size()));
+	vector<float> output(input.size());
+	vkBase.download(output.size() * sizeof(float), 0u, [&output](const void* data, VkDeviceSize size)
+	{
+		memcpy(output.data(), data, size_t(size));
+	});
+	vkBase.pollReadbacks(true);
+	vkBase.submissionLog();
+	vkBase.residencyLog();
+	vkBase.terminate();
+	return 0;
+}
+#else
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
 	glfwInit();
@@ -10,13 +55,35 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 	glfwWindowHint(GLFW_RESIZABLE, 0);
 	auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
 
+	VulkanCapabilities capabilities;
+#ifdef _DEBUG
+	capabilities.enableValidation = true;
+#endif
 	VulkanBase vkBase;
-	vkBase.initialize(window, AppTitle);
+	if (!vkBase.initialize(window, AppTitle, capabilities))
+	{
+		vkBase.terminate();
+		glfwTerminate();
+		return 1;
+	}
+	vector<float> input(256u, 0.0f);
+	vkBase.upload(input.data(), input.size() * sizeof(float));
+	vkBase.compute(uint32_t(input.size()));
+	vector<float> output(input.size());
+	vkBase.download(output.size() * sizeof(float), 0u, [&output](const void* data, VkDeviceSize size)
+	{
+		memcpy(output.data(), data, size_t(size));
+	});
 	while (glfwWindowShouldClose(window) == GLFW_FALSE)
 	{
 		glfwPollEvents();
+		//結果が戻っていればoutputへ書き込まれる
+		vkBase.pollReadbacks();
+		//バッチの合間に長く持つバッファのメモリを少しずつ詰める
+		vkBase.defragment(1000u);
 	}
-	glfwTerminate();
 	vkBase.terminate();
+	glfwTerminate();
 	return 0;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
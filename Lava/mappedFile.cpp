@@ -0,0 +1,188 @@
+#include "mappedFile.h"
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+#if defined(_WIN32)
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	file = -1;
+#endif
+	fileSize = 0u;
+	writable = false;
+}
+
+bool MappedFile::open(const char* fileName, vector<const char*>& errors)
+{
+	close();
+	writable = false;
+#if defined(_WIN32)
+	//先頭から順に読むことをキャッシュマネージャに伝え、先読みを深くする
+	file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER fileSizeEx{};
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSizeEx))
+	{
+		errors.push_back("CreateFileA is failed in MappedFile::open");
+		close();
+		return false;
+	}
+	fileSize = uint64_t(fileSizeEx.QuadPart);
+#else
+	file = ::open(fileName, O_RDONLY);
+	struct stat fileStat{};
+	if (file < 0 || fstat(file, &fileStat) != 0)
+	{
+		errors.push_back("open is failed in MappedFile::open");
+		close();
+		return false;
+	}
+	fileSize = uint64_t(fileStat.st_size);
+#endif
+	return mapFile(errors);
+}
+
+bool MappedFile::create(const char* fileName, uint64_t size, vector<const char*>& errors)
+{
+	close();
+	writable = true;
+	fileSize = size;
+#if defined(_WIN32)
+	file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0u, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		errors.push_back("CreateFileA is failed in MappedFile::create");
+		close();
+		return false;
+	}
+#else
+	file = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	//書き込む前に大きさを決めておけば、窓を写すだけで書ける
+	if (file < 0 || ftruncate(file, off_t(size)) != 0)
+	{
+		errors.push_back("open is failed in MappedFile::create");
+		close();
+		return false;
+	}
+#endif
+	return mapFile(errors);
+}
+
+//Windowsではファイル全体のマッピングオブジェクトを作っておき、窓はMapViewOfFileで切り出す。
+//作り直したファイルはここでsizeまで伸びる。
+bool MappedFile::mapFile(vector<const char*>& errors)
+{
+#if defined(_WIN32)
+	if (fileSize == 0u)
+	{
+		//空のファイルはマッピングできないが、写す窓も無い
+		return true;
+	}
+	mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, DWORD(fileSize >> 32), DWORD(fileSize), nullptr);
+	if (mapping == nullptr)
+	{
+		errors.push_back("CreateFileMappingA is failed in MappedFile::mapFile");
+		close();
+		return false;
+	}
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+	if (mapping != nullptr)
+	{
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (file >= 0)
+	{
+		::close(file);
+		file = -1;
+	}
+#endif
+	fileSize = 0u;
+}
+
+bool MappedFile::isOpen() const
+{
+#if defined(_WIN32)
+	return file != INVALID_HANDLE_VALUE;
+#else
+	return file >= 0;
+#endif
+}
+
+uint64_t MappedFile::size() const
+{
+	return fileSize;
+}
+
+MappedView MappedFile::map(uint64_t offset, size_t size)
+{
+	MappedView view{};
+	if (!isOpen() || size == 0u || offset + size > fileSize)
+	{
+		return view;
+	}
+	const uint64_t alignedOffset = offset / granularity() * granularity();
+	const size_t mappedSize = size_t(offset - alignedOffset) + size;
+#if defined(_WIN32)
+	void* base = MapViewOfFile(mapping, writable ? FILE_MAP_READ | FILE_MAP_WRITE : FILE_MAP_READ, DWORD(alignedOffset >> 32), DWORD(alignedOffset), mappedSize);
+	if (base == nullptr)
+	{
+		return view;
+	}
+#else
+	void* base = mmap(nullptr, mappedSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, off_t(alignedOffset));
+	if (base == MAP_FAILED)
+	{
+		return view;
+	}
+	//窓は先頭から一度だけ読み書きするので、先読みを深くする
+	madvise(base, mappedSize, MADV_SEQUENTIAL);
+#endif
+	view.base = base;
+	view.data = static_cast<uint8_t*>(base) + (offset - alignedOffset);
+	view.mappedSize = mappedSize;
+	return view;
+}
+
+//書き込んだページの書き戻しはOSに任せる。閉じた後も内容はファイルに残る。
+void MappedFile::unmap(MappedView& view)
+{
+	if (view.base == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(view.base);
+#else
+	munmap(view.base, view.mappedSize);
+#endif
+	view = MappedView{};
+}
+
+uint64_t MappedFile::granularity()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO systemInfo{};
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwAllocationGranularity;
+#else
+	return uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+}
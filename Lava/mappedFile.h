@@ -0,0 +1,48 @@
+#pragma once
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+//MappedFile::mapで切り出した窓。dataは要求したオフセットを指し、baseは割り当て粒度に揃えた先頭。
+struct MappedView
+{
+	void* base;
+	void* data;
+	size_t mappedSize;
+};
+
+//ディスク上のファイルを窓ごとにアドレス空間へ写す。ファイル全体は写さないので、
+//ホストのメモリより大きなファイルも窓を動かしながら読み書きできる。
+class MappedFile
+{
+public:
+	MappedFile();
+	//既存のファイルを読み込み専用で開く
+	bool open(const char* fileName, vector<const char*>& errors);
+	//sizeバイトのファイルを作り直し、読み書きできるように開く
+	bool create(const char* fileName, uint64_t size, vector<const char*>& errors);
+	void close();
+	bool isOpen() const;
+	uint64_t size() const;
+	//offsetからsizeバイトを写す。失敗するとdataがnullptrになる。
+	MappedView map(uint64_t offset, size_t size);
+	static void unmap(MappedView& view);
+	//mapのオフセットを揃える単位。Windowsでは64KiB、それ以外ではページサイズ。
+	static uint64_t granularity();
+private:
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+	uint64_t fileSize;
+	bool writable;
+	bool mapFile(vector<const char*>& errors);
+};
@@ -0,0 +1,120 @@
+#include "memoryTracker.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+//確保した領域の直前に置く管理情報
+struct AllocationHeader
+{
+	void* base;
+	size_t size;
+};
+
+HostMemoryTracker::HostMemoryTracker() : current(0u), peak(0u), count(0u)
+{
+	allocationCallbacks = {};
+	allocationCallbacks.pUserData = this;
+	allocationCallbacks.pfnAllocation = allocationFunction;
+	allocationCallbacks.pfnReallocation = reallocationFunction;
+	allocationCallbacks.pfnFree = freeFunction;
+	allocationCallbacks.pfnInternalAllocation = nullptr;
+	allocationCallbacks.pfnInternalFree = nullptr;
+}
+
+const VkAllocationCallbacks* HostMemoryTracker::callbacks() const
+{
+	return &allocationCallbacks;
+}
+
+size_t HostMemoryTracker::currentBytes() const
+{
+	return current.load();
+}
+
+size_t HostMemoryTracker::peakBytes() const
+{
+	return peak.load();
+}
+
+size_t HostMemoryTracker::allocationCount() const
+{
+	return count.load();
+}
+
+void* HostMemoryTracker::allocate(size_t size, size_t alignment)
+{
+	if (size == 0u)
+	{
+		return nullptr;
+	}
+	if (alignment < alignof(max_align_t))
+	{
+		alignment = alignof(max_align_t);
+	}
+	void* base = malloc(size + alignment + sizeof(AllocationHeader));
+	if (base == nullptr)
+	{
+		return nullptr;
+	}
+	const uintptr_t address = (uintptr_t(base) + sizeof(AllocationHeader) + alignment - 1u) & ~uintptr_t(alignment - 1u);
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(address) - 1;
+	header->base = base;
+	header->size = size;
+
+	const size_t now = current.fetch_add(size) + size;
+	size_t previousPeak = peak.load();
+	while (now > previousPeak && !peak.compare_exchange_weak(previousPeak, now))
+	{
+	}
+	count++;
+	return reinterpret_cast<void*>(address);
+}
+
+void* HostMemoryTracker::reallocate(void* original, size_t size, size_t alignment)
+{
+	if (original == nullptr)
+	{
+		return allocate(size, alignment);
+	}
+	if (size == 0u)
+	{
+		free(original);
+		return nullptr;
+	}
+	void* memory = allocate(size, alignment);
+	if (memory == nullptr)
+	{
+		return nullptr;
+	}
+	const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(original) - 1;
+	memcpy(memory, original, header->size < size ? header->size : size);
+	free(original);
+	return memory;
+}
+
+void HostMemoryTracker::free(void* memory)
+{
+	if (memory == nullptr)
+	{
+		return;
+	}
+	const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(memory) - 1;
+	current.fetch_sub(header->size);
+	::free(header->base);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostMemoryTracker::allocationFunction(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostMemoryTracker*>(userData)->allocate(size, alignment);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostMemoryTracker::reallocationFunction(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostMemoryTracker*>(userData)->reallocate(original, size, alignment);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostMemoryTracker::freeFunction(void* userData, void* memory)
+{
+	static_cast<HostMemoryTracker*>(userData)->free(memory);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+
+using namespace std;
+
+//VkAllocationCallbacks経由でドライバーが確保したホストメモリを数える。
+class HostMemoryTracker
+{
+public:
+	HostMemoryTracker();
+	const VkAllocationCallbacks* callbacks() const;
+	size_t currentBytes() const;
+	size_t peakBytes() const;
+	size_t allocationCount() const;
+private:
+	VkAllocationCallbacks allocationCallbacks;
+	atomic<size_t> current;
+	atomic<size_t> peak;
+	atomic<size_t> count;
+	void* allocate(size_t size, size_t alignment);
+	void* reallocate(void* original, size_t size, size_t alignment);
+	void free(void* memory);
+	static VKAPI_ATTR void* VKAPI_CALL allocationFunction(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL reallocationFunction(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL freeFunction(void* userData, void* memory);
+};
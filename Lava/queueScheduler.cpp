@@ -0,0 +1,54 @@
+#include "queueScheduler.h"
+
+QueueScheduler::QueueScheduler()
+{
+	interactiveIndex = 0u;
+	nextBulkIndex = 0u;
+}
+
+void QueueScheduler::create(const vector<SubmissionEngine*>& engines, const vector<float>& priorities)
+{
+	this->engines = engines;
+	interactiveIndex = 0u;
+	nextBulkIndex = 0u;
+	for (uint32_t i = 1; i < priorities.size(); i++)
+	{
+		if (priorities[i] > priorities[interactiveIndex])
+		{
+			interactiveIndex = i;
+		}
+	}
+}
+
+SubmissionEngine& QueueScheduler::select(JobPriority priority)
+{
+	const uint32_t count = uint32_t(engines.size());
+	if (priority == JobPriority::Interactive || count == 1u)
+	{
+		return *engines[interactiveIndex];
+	}
+	//Bulkは優先度の高いキューを避け、完了していないジョブが一番少ないキューを選ぶ。同じなら順番に回す。
+	uint32_t selected = UINT32_MAX;
+	uint64_t selectedOutstanding = UINT64_MAX;
+	for (uint32_t n = 0; n < count; n++)
+	{
+		const uint32_t i = (nextBulkIndex + n) % count;
+		if (i == interactiveIndex)
+		{
+			continue;
+		}
+		const uint64_t outstanding = engines[i]->submittedValue() - engines[i]->poll();
+		if (outstanding < selectedOutstanding)
+		{
+			selected = i;
+			selectedOutstanding = outstanding;
+		}
+	}
+	nextBulkIndex = (selected + 1u) % count;
+	return *engines[selected];
+}
+
+uint32_t QueueScheduler::engineCount() const
+{
+	return uint32_t(engines.size());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "submissionEngine.h"
+
+using namespace std;
+
+//Interactiveは優先度の最も高いキューへ、Bulkはそれ以外のキューのうち空いているものへ送る
+enum class JobPriority
+{
+	Bulk,
+	Interactive,
+};
+
+//計算ファミリーの複数のキューに互いに独立したジョブを振り分ける。
+//大量のBulkジョブが詰まっていても、Interactiveのジョブは優先度の高いキューで先に流れる。
+class QueueScheduler
+{
+public:
+	QueueScheduler();
+	void create(const vector<SubmissionEngine*>& engines, const vector<float>& priorities);
+	SubmissionEngine& select(JobPriority priority);
+	uint32_t engineCount() const;
+private:
+	vector<SubmissionEngine*> engines;
+	uint32_t interactiveIndex;
+	uint32_t nextBulkIndex;
+};
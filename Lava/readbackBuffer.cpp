@@ -0,0 +1,110 @@
+#include "readbackBuffer.h"
+
+ReadbackBuffer::ReadbackBuffer()
+{
+	allocator = VK_NULL_HANDLE;
+	size = 0u;
+}
+
+void ReadbackBuffer::create(VmaAllocator allocator, VkDeviceSize slotSize, uint32_t slotCount, vector<const char*>& errors)
+{
+	this->allocator = allocator;
+	size = slotSize;
+	slots.resize(slotCount);
+	for (auto& slot : slots)
+	{
+		VmaAllocationCreateInfo readbackAllocInfo{};
+		readbackAllocInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU; //GPUが書き込みCPUが読むメモリで、ホスト側でキャッシュされるもの。
+		readbackAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		VkBufferCreateInfo bufferCI{};
+		bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCI.pNext = nullptr;
+		bufferCI.flags = 0;
+		bufferCI.size = slotSize;
+		bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCI.queueFamilyIndexCount = 0;
+		bufferCI.pQueueFamilyIndices = nullptr;
+		VmaAllocationInfo allocationInfo{};
+		slot = Slot{};
+		if (vmaCreateBuffer(allocator, &bufferCI, &readbackAllocInfo, &slot.buffer, &slot.allocation, &allocationInfo) != VK_SUCCESS)
+		{
+			errors.push_back("vmaCreateBuffer failled in ReadbackBuffer::create");
+			continue;
+		}
+		slot.mapped = allocationInfo.pMappedData;
+	}
+}
+
+void ReadbackBuffer::destroy()
+{
+	for (auto& slot : slots)
+	{
+		if (slot.buffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(allocator, slot.buffer, slot.allocation);
+		}
+	}
+	slots.clear();
+}
+
+bool ReadbackBuffer::acquire(uint32_t& slot)
+{
+	for (uint32_t i = 0; i < slots.size(); i++)
+	{
+		if (!slots[i].busy && slots[i].buffer != VK_NULL_HANDLE)
+		{
+			slot = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//slotへのコピーを値valueのサブミットに積んだことを記録する
+void ReadbackBuffer::submit(uint32_t slot, uint64_t value, VkDeviceSize size, Callback callback)
+{
+	slots[slot].value = value;
+	slots[slot].size = size;
+	slots[slot].callback = callback;
+	slots[slot].busy = true;
+}
+
+//完了したスロットの内容をコールバックに渡して空ける。古いサブミットから順に渡す。
+void ReadbackBuffer::collect(uint64_t completedValue)
+{
+	for (;;)
+	{
+		Slot* oldest = nullptr;
+		for (auto& slot : slots)
+		{
+			if (slot.busy && slot.value <= completedValue && (oldest == nullptr || slot.value < oldest->value))
+			{
+				oldest = &slot;
+			}
+		}
+		if (oldest == nullptr)
+		{
+			return;
+		}
+		//HOST_COHERENTでない場合だけVMAが実際に無効化する
+		vmaInvalidateAllocation(allocator, oldest->allocation, 0u, oldest->size);
+		Callback callback = move(oldest->callback);
+		oldest->callback = nullptr;
+		oldest->busy = false;
+		if (callback)
+		{
+			callback(oldest->mapped, oldest->size);
+		}
+	}
+}
+
+VkBuffer ReadbackBuffer::buffer(uint32_t slot) const
+{
+	return slots[slot].buffer;
+}
+
+VkDeviceSize ReadbackBuffer::slotSize() const
+{
+	return size;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//download()が返す受け取り票。valueのサブミットが完了すると結果が読める。
+struct ReadbackTicket
+{
+	uint32_t slot;
+	uint64_t value;
+};
+
+//GPUからCPUへ結果を戻すためのホストキャッシュ付きメモリ。
+//複数のスロットを持ち、前の結果を読み出している間に次のコピーを積める。
+class ReadbackBuffer
+{
+public:
+	using Callback = function<void(const void* data, VkDeviceSize size)>;
+	ReadbackBuffer();
+	void create(VmaAllocator allocator, VkDeviceSize slotSize, uint32_t slotCount, vector<const char*>& errors);
+	void destroy();
+	bool acquire(uint32_t& slot);
+	void submit(uint32_t slot, uint64_t value, VkDeviceSize size, Callback callback);
+	void collect(uint64_t completedValue);
+	VkBuffer buffer(uint32_t slot) const;
+	VkDeviceSize slotSize() const;
+private:
+	struct Slot
+	{
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		void* mapped;
+		uint64_t value;
+		VkDeviceSize size;
+		Callback callback;
+		bool busy;
+	};
+	VmaAllocator allocator;
+	VkDeviceSize size;
+	vector<Slot> slots;
+};
@@ -0,0 +1,371 @@
+#include "residencyManager.h"
+
+ResidencyManager::ResidencyManager()
+{
+	watermark = 0.9f;
+	allocator = VK_NULL_HANDLE;
+	devicePool = VK_NULL_HANDLE;
+	usage = 0u;
+	errors = nullptr;
+	deviceHeapIndex = 0u;
+	useClock = 0u;
+	residentTotal = 0u;
+	evictedTotal = 0u;
+	evictions = 0u;
+	restores = 0u;
+}
+
+//VK_EXT_memory_budgetが無くても、VMAは自分の確保とヒープの大きさから使用量と予算を見積もる
+void ResidencyManager::create(VmaAllocator allocator, VmaPool devicePool, VkBufferUsageFlags usage, const vector<uint32_t>& queueFamilyIndices, const VkPhysicalDeviceMemoryProperties& memoryProperties, vector<const char*>& errors)
+{
+	this->allocator = allocator;
+	this->devicePool = devicePool;
+	this->usage = usage;
+	this->queueFamilyIndices = queueFamilyIndices;
+	this->errors = &errors;
+	budgets.resize(memoryProperties.memoryHeapCount);
+	updateBudgets();
+	//追い出すかどうかはデバイス側の実体を置くヒープだけで決める
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	bufferCI.size = 1024u;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
+	VmaAllocationCreateInfo residentAllocInfo{};
+	residentAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	uint32_t memoryTypeIndex = 0u;
+	if (vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferCI, &residentAllocInfo, &memoryTypeIndex) != VK_SUCCESS)
+	{
+		errors.push_back("vmaFindMemoryTypeIndexForBufferInfo failled in ResidencyManager::create");
+		return;
+	}
+	deviceHeapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+}
+
+void ResidencyManager::destroy()
+{
+	if (allocator == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//GPUが何も使っていない時に呼ぶので、チケットを待たずに全て破棄する
+	collect([](uint64_t) { return true; });
+	for (auto& entry : entries)
+	{
+		if (entry.buffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(allocator, entry.buffer, entry.allocation);
+		}
+		if (entry.moveBuffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(allocator, entry.moveBuffer, entry.moveAllocation);
+		}
+	}
+	entries.clear();
+	freeHandles.clear();
+	residentTotal = 0u;
+	evictedTotal = 0u;
+	allocator = VK_NULL_HANDLE;
+}
+
+void ResidencyManager::updateBudgets()
+{
+	if (!budgets.empty())
+	{
+		vmaGetHeapBudgets(allocator, budgets.data());
+	}
+}
+
+const VmaBudget& ResidencyManager::heapBudget(uint32_t heapIndex) const
+{
+	return budgets[heapIndex];
+}
+
+uint32_t ResidencyManager::heapCount() const
+{
+	return uint32_t(budgets.size());
+}
+
+VkDeviceSize ResidencyManager::excessBytes(VkDeviceSize incoming) const
+{
+	if (budgets.empty())
+	{
+		return 0u;
+	}
+	const VmaBudget& budget = budgets[deviceHeapIndex];
+	const VkDeviceSize limit = VkDeviceSize(double(budget.budget) * watermark);
+	return budget.usage + incoming > limit ? budget.usage + incoming - limit : 0u;
+}
+
+VkBufferCreateInfo ResidencyManager::bufferCreateInfo(VkDeviceSize size) const
+{
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	bufferCI.size = size;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = queueFamilyIndices.size() > 1u ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = queueFamilyIndices.size() > 1u ? uint32_t(queueFamilyIndices.size()) : 0u;
+	bufferCI.pQueueFamilyIndices = queueFamilyIndices.size() > 1u ? queueFamilyIndices.data() : nullptr;
+	return bufferCI;
+}
+
+bool ResidencyManager::createBuffer(VkDeviceSize size, bool deviceLocal, VkBuffer& buffer, VmaAllocation& allocation)
+{
+	VmaAllocationCreateInfo residentAllocInfo{};
+	//デバイス側は長く持つバッファのプールから、ホスト側はGPUから読み書きできるホストメモリから取る
+	residentAllocInfo.usage = deviceLocal ? VMA_MEMORY_USAGE_GPU_ONLY : VMA_MEMORY_USAGE_CPU_ONLY;
+	residentAllocInfo.pool = deviceLocal ? devicePool : VK_NULL_HANDLE;
+	const VkBufferCreateInfo bufferCI = bufferCreateInfo(size);
+	if (vmaCreateBuffer(allocator, &bufferCI, &residentAllocInfo, &buffer, &allocation, nullptr) != VK_SUCCESS)
+	{
+		buffer = VK_NULL_HANDLE;
+		allocation = VK_NULL_HANDLE;
+		return false;
+	}
+	return true;
+}
+
+bool ResidencyManager::add(VkDeviceSize size, ResidentBuffer& buffer)
+{
+	buffer.handle = ResidentInvalidHandle;
+	buffer.size = size;
+	Entry entry{};
+	if (!createBuffer(size, true, entry.buffer, entry.allocation))
+	{
+		errors->push_back("vmaCreateBuffer failled in ResidencyManager::add");
+		return false;
+	}
+	entry.size = size;
+	entry.lastUse = ++useClock;
+	entry.resident = true;
+	entry.live = true;
+	if (!freeHandles.empty())
+	{
+		buffer.handle = freeHandles.back();
+		freeHandles.pop_back();
+		entries[buffer.handle] = entry;
+	}
+	else
+	{
+		buffer.handle = uint32_t(entries.size());
+		entries.push_back(entry);
+	}
+	residentTotal += size;
+	return true;
+}
+
+void ResidencyManager::remove(ResidentBuffer& buffer)
+{
+	if (buffer.handle == ResidentInvalidHandle)
+	{
+		return;
+	}
+	Entry& entry = entries[buffer.handle];
+	(entry.resident ? residentTotal : evictedTotal) -= entry.size;
+	garbage.push_back({ entry.buffer, entry.allocation, entry.ticket });
+	if (entry.moveBuffer != VK_NULL_HANDLE)
+	{
+		garbage.push_back({ entry.moveBuffer, entry.moveAllocation, entry.ticket });
+	}
+	entry = Entry{};
+	freeHandles.push_back(buffer.handle);
+	buffer.handle = ResidentInvalidHandle;
+}
+
+bool ResidencyManager::resident(uint32_t handle) const
+{
+	return entries[handle].resident;
+}
+
+VkBuffer ResidencyManager::buffer(uint32_t handle) const
+{
+	return entries[handle].buffer;
+}
+
+uint64_t ResidencyManager::ticket(uint32_t handle) const
+{
+	return entries[handle].ticket;
+}
+
+void ResidencyManager::touch(uint32_t handle, uint64_t ticket)
+{
+	if (ticket != 0u)
+	{
+		entries[handle].ticket = ticket;
+	}
+	entries[handle].lastUse = ++useClock;
+}
+
+//一番古いものを線形に探す。預かるバッファは長く持つものなので数は多くない。
+bool ResidencyManager::beginEvict(uint32_t exclude, ResidencyMove& move)
+{
+	uint32_t victim = ResidentInvalidHandle;
+	for (uint32_t i = 0; i < uint32_t(entries.size()); i++)
+	{
+		const Entry& entry = entries[i];
+		if (!entry.live || !entry.resident || entry.moveBuffer != VK_NULL_HANDLE || i == exclude)
+		{
+			continue;
+		}
+		if (victim == ResidentInvalidHandle || entry.lastUse < entries[victim].lastUse)
+		{
+			victim = i;
+		}
+	}
+	if (victim == ResidentInvalidHandle)
+	{
+		return false;
+	}
+	Entry& entry = entries[victim];
+	if (!createBuffer(entry.size, false, entry.moveBuffer, entry.moveAllocation))
+	{
+		errors->push_back("vmaCreateBuffer failled in ResidencyManager::beginEvict");
+		return false;
+	}
+	move.handle = victim;
+	move.srcBuffer = entry.buffer;
+	move.dstBuffer = entry.moveBuffer;
+	move.size = entry.size;
+	return true;
+}
+
+bool ResidencyManager::beginRestore(uint32_t handle, ResidencyMove& move)
+{
+	Entry& entry = entries[handle];
+	if (entry.resident || entry.moveBuffer != VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	if (!createBuffer(entry.size, true, entry.moveBuffer, entry.moveAllocation))
+	{
+		errors->push_back("vmaCreateBuffer failled in ResidencyManager::beginRestore");
+		return false;
+	}
+	move.handle = handle;
+	move.srcBuffer = entry.buffer;
+	move.dstBuffer = entry.moveBuffer;
+	move.size = entry.size;
+	return true;
+}
+
+//元の実体はコピーが読み終えるまで残す
+void ResidencyManager::endMove(const ResidencyMove& move, uint64_t ticket)
+{
+	Entry& entry = entries[move.handle];
+	garbage.push_back({ entry.buffer, entry.allocation, ticket });
+	entry.buffer = entry.moveBuffer;
+	entry.allocation = entry.moveAllocation;
+	entry.moveBuffer = VK_NULL_HANDLE;
+	entry.moveAllocation = VK_NULL_HANDLE;
+	entry.ticket = ticket;
+	entry.resident = !entry.resident;
+	if (entry.resident)
+	{
+		evictedTotal -= entry.size;
+		residentTotal += entry.size;
+		restores++;
+	}
+	else
+	{
+		residentTotal -= entry.size;
+		evictedTotal += entry.size;
+		evictions++;
+	}
+}
+
+void ResidencyManager::collect(const function<bool(uint64_t ticket)>& completed)
+{
+	size_t kept = 0u;
+	for (size_t i = 0; i < garbage.size(); i++)
+	{
+		if (garbage[i].ticket == 0u || completed(garbage[i].ticket))
+		{
+			vmaDestroyBuffer(allocator, garbage[i].buffer, garbage[i].allocation);
+			continue;
+		}
+		garbage[kept++] = garbage[i];
+	}
+	garbage.resize(kept);
+}
+
+VkDeviceSize ResidencyManager::residentBytes() const
+{
+	return residentTotal;
+}
+
+VkDeviceSize ResidencyManager::evictedBytes() const
+{
+	return evictedTotal;
+}
+
+uint64_t ResidencyManager::evictionCount() const
+{
+	return evictions;
+}
+
+uint64_t ResidencyManager::restoreCount() const
+{
+	return restores;
+}
+
+//移している途中のバッファと、破棄を待っている古い実体は動かさない
+ResidencyManager::Entry* ResidencyManager::findEntry(VmaAllocation allocation)
+{
+	for (auto& entry : entries)
+	{
+		if (entry.live && entry.allocation == allocation && entry.moveBuffer == VK_NULL_HANDLE)
+		{
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+uint32_t ResidencyManager::findHandle(VmaAllocation allocation) const
+{
+	for (uint32_t handle = 0u; handle < uint32_t(entries.size()); handle++)
+	{
+		const Entry& entry = entries[handle];
+		if (entry.live && entry.allocation == allocation && entry.moveBuffer == VK_NULL_HANDLE)
+		{
+			return handle;
+		}
+	}
+	return ResidentInvalidHandle;
+}
+
+bool ResidencyManager::createMovedBuffer(VmaAllocation allocation, VmaAllocation dstAllocation, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size)
+{
+	Entry* entry = findEntry(allocation);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+	const VkBufferCreateInfo bufferCI = bufferCreateInfo(entry->size);
+	if (vmaCreateAliasingBuffer(allocator, dstAllocation, &bufferCI, &dstBuffer) != VK_SUCCESS)
+	{
+		errors->push_back("vmaCreateAliasingBuffer failled in ResidencyManager::createMovedBuffer");
+		return false;
+	}
+	srcBuffer = entry->buffer;
+	size = entry->size;
+	return true;
+}
+
+VkBuffer ResidencyManager::replaceBuffer(VmaAllocation allocation, VkBuffer buffer)
+{
+	Entry* entry = findEntry(allocation);
+	if (entry == nullptr)
+	{
+		return VK_NULL_HANDLE;
+	}
+	VkBuffer oldBuffer = entry->buffer;
+	entry->buffer = buffer;
+	return oldBuffer;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//登録できなかった時のハンドル
+static const uint32_t ResidentInvalidHandle = UINT32_MAX;
+
+//ResidencyManagerに預けたバッファ。実体はデバイスローカルかホストのどちらかにあり、VkBufferは移すたびに変わる。
+struct ResidentBuffer
+{
+	uint32_t handle;
+	VkDeviceSize size;
+};
+
+//追い出しや戻しで、srcBufferからdstBufferへsizeバイトをコピーする
+struct ResidencyMove
+{
+	uint32_t handle;
+	VkBuffer srcBuffer;
+	VkBuffer dstBuffer;
+	VkDeviceSize size;
+};
+
+//vmaGetHeapBudgetsでヒープごとの使用量と予算を見て、デバイスローカルのヒープが予算のwatermarkの割合を超えたら、
+//長く使われていないバッファをホストメモリへ追い出す。追い出したバッファはカーネルが使う時に戻す。
+//コピーの記録とサブミットは呼び出し側が行い、その完了のチケットをendMoveで渡す。
+//移し終えた元の実体は、そのチケットの完了をcollectで確かめてから破棄する。
+class ResidencyManager
+{
+public:
+	ResidencyManager();
+	//バッファはどちらの実体もqueueFamilyIndicesのキューで持ち主を移さずに使えるよう作る。デバイス側はdevicePoolから取る。
+	void create(VmaAllocator allocator, VmaPool devicePool, VkBufferUsageFlags usage, const vector<uint32_t>& queueFamilyIndices, const VkPhysicalDeviceMemoryProperties& memoryProperties, vector<const char*>& errors);
+	void destroy();
+	//デバイスローカルのヒープの予算に対する割合。これを超えた分を追い出す。
+	float watermark;
+	void updateBudgets();
+	const VmaBudget& heapBudget(uint32_t heapIndex) const;
+	uint32_t heapCount() const;
+	//updateBudgetsの時点で、デバイス側の実体を置くヒープにさらにincomingバイトを置くとwatermarkを超える分
+	VkDeviceSize excessBytes(VkDeviceSize incoming = 0u) const;
+	//デバイスローカルに作って預かる
+	bool add(VkDeviceSize size, ResidentBuffer& buffer);
+	//最後に使ったサブミットの完了を待ってから破棄する
+	void remove(ResidentBuffer& buffer);
+	bool resident(uint32_t handle) const;
+	//今の実体のバッファ。追い出されていればホスト側のバッファを返す。
+	VkBuffer buffer(uint32_t handle) const;
+	//バッファを最後に読み書きしたサブミットのチケット。次に使うサブミットはこれを待つこと。
+	uint64_t ticket(uint32_t handle) const;
+	void touch(uint32_t handle, uint64_t ticket);
+	//excludeを除いて一番長く使われていない常駐バッファを選び、ホスト側の実体を作る
+	bool beginEvict(uint32_t exclude, ResidencyMove& move);
+	//追い出されているバッファのデバイス側の実体を作り直す
+	bool beginRestore(uint32_t handle, ResidencyMove& move);
+	//moveのコピーを積んだサブミットのチケットを渡し、移し先を今の実体にする
+	void endMove(const ResidencyMove& move, uint64_t ticket);
+	//completedがtrueを返したチケットを待っていた古い実体を破棄する
+	void collect(const function<bool(uint64_t ticket)>& completed);
+	VkDeviceSize residentBytes() const;
+	VkDeviceSize evictedBytes() const;
+	uint64_t evictionCount() const;
+	uint64_t restoreCount() const;
+	//デフラグでallocationがdstAllocationへ移されるなら、移し先に同じ作りのバッファを作ってコピーの範囲を返す。
+	//allocationが預かっているバッファの今の実体でなければfalseを返す。
+	bool createMovedBuffer(VmaAllocation allocation, VmaAllocation dstAllocation, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size);
+	//allocationが今の実体になっているバッファのハンドル。無ければResidentInvalidHandleを返す。
+	uint32_t findHandle(VmaAllocation allocation) const;
+	//コピーを終えた実体のバッファを差し替えて、古いバッファを返す
+	VkBuffer replaceBuffer(VmaAllocation allocation, VkBuffer buffer);
+private:
+	struct Entry
+	{
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		VkDeviceSize size;
+		uint64_t ticket;
+		uint64_t lastUse;
+		bool resident;
+		bool live;
+		//beginEvict/beginRestoreで作った移し先
+		VkBuffer moveBuffer;
+		VmaAllocation moveAllocation;
+	};
+	struct Garbage
+	{
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		uint64_t ticket;
+	};
+	VmaAllocator allocator;
+	VmaPool devicePool;
+	VkBufferUsageFlags usage;
+	vector<uint32_t> queueFamilyIndices;
+	vector<const char*>* errors;
+	vector<VmaBudget> budgets;
+	uint32_t deviceHeapIndex;
+	vector<Entry> entries;
+	vector<uint32_t> freeHandles;
+	vector<Garbage> garbage;
+	uint64_t useClock;
+	VkDeviceSize residentTotal;
+	VkDeviceSize evictedTotal;
+	uint64_t evictions;
+	uint64_t restores;
+	VkBufferCreateInfo bufferCreateInfo(VkDeviceSize size) const;
+	bool createBuffer(VkDeviceSize size, bool deviceLocal, VkBuffer& buffer, VmaAllocation& allocation);
+	Entry* findEntry(VmaAllocation allocation);
+};
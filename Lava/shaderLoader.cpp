@@ -0,0 +1,91 @@
+#include "shaderLoader.h"
+
+//SPIR-Vのヘッダーの先頭の語。バイト順が逆のものは受け付けない。
+static const uint32_t SpirvMagicNumber = 0x07230203u;
+//マジックナンバー、バージョン、生成元、Bound、予約の5語
+static const size_t SpirvHeaderWords = 5u;
+
+SpirvBinary::SpirvBinary()
+{
+	view = {};
+	code = nullptr;
+	count = 0u;
+}
+
+bool SpirvBinary::load(const char* fileName, vector<const char*>& errors)
+{
+	release();
+	if (!file.open(fileName, errors))
+	{
+		return false;
+	}
+	//マップしたページは割り当て粒度に揃っているので、そのままuint32_tの配列として読める
+	const uint64_t size = file.size();
+	view = file.map(0u, size_t(size));
+	if (view.data == nullptr || size % sizeof(uint32_t) != 0u)
+	{
+		errors.push_back("spv file is empty or truncated in SpirvBinary::load");
+		release();
+		return false;
+	}
+	assign(static_cast<const uint32_t*>(view.data), size_t(size / sizeof(uint32_t)));
+	if (!valid())
+	{
+		errors.push_back("spv file is not a SPIR-V module in SpirvBinary::load");
+		release();
+		return false;
+	}
+	return true;
+}
+
+void SpirvBinary::assign(const uint32_t* words, size_t wordCount)
+{
+	code = words;
+	count = wordCount;
+}
+
+void SpirvBinary::release()
+{
+	MappedFile::unmap(view);
+	file.close();
+	code = nullptr;
+	count = 0u;
+}
+
+bool SpirvBinary::valid() const
+{
+	return code != nullptr && count >= SpirvHeaderWords && code[0] == SpirvMagicNumber;
+}
+
+const uint32_t* SpirvBinary::words() const
+{
+	return code;
+}
+
+size_t SpirvBinary::wordCount() const
+{
+	return count;
+}
+
+//ドライバーは作成中に語列を写し取るので、作った後はrelease()してよい
+VkShaderModule SpirvBinary::createShaderModule(VkDevice device, vector<const char*>& errors) const
+{
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	if (!valid())
+	{
+		errors.push_back("SPIR-V is not loaded in createShaderModule");
+		return shaderModule;
+	}
+	VkShaderModuleCreateInfo shaderModuleCI{};
+	shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCI.pNext = nullptr;
+	shaderModuleCI.flags = 0u;
+	shaderModuleCI.codeSize = count * sizeof(uint32_t);
+	shaderModuleCI.pCode = code;
+	if (vkCreateShaderModule(device, &shaderModuleCI, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateShaderModule is failed in createShaderModule");
+		shaderModule = VK_NULL_HANDLE;
+	}
+	return shaderModule;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "mappedFile.h"
+
+using namespace std;
+
+//SPIR-Vの語列。ファイルから読んだものはマップしたページを、埋め込みのものはその配列をそのまま指すので、
+//バイト単位の読み込みもコピーも無く、pCodeは常に4バイトに揃っている。
+class SpirvBinary
+{
+public:
+	SpirvBinary();
+	//ファイルをマップする。無い、またはSPIR-Vでなければfalseを返し、エラーに積む。
+	bool load(const char* fileName, vector<const char*>& errors);
+	//ビルド時に埋め込んだconstexprの配列を指す。ファイルシステムには触れない。
+	template<size_t N>
+	void assign(const uint32_t (&words)[N])
+	{
+		assign(words, N);
+	}
+	void assign(const uint32_t* words, size_t wordCount);
+	void release();
+	bool valid() const;
+	const uint32_t* words() const;
+	size_t wordCount() const;
+	VkShaderModule createShaderModule(VkDevice device, vector<const char*>& errors) const;
+private:
+	MappedFile file;
+	MappedView view;
+	const uint32_t* code;
+	size_t count;
+};
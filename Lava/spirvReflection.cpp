@@ -0,0 +1,398 @@
+#include "spirvReflection.h"
+#include <algorithm>
+
+//読み取りに使う命令、デコレーション、ストレージクラスの番号。値はSPIR-Vの仕様書による。
+static const uint32_t SpirvMagicNumber = 0x07230203u;
+static const size_t SpirvHeaderWords = 5u;
+static const uint32_t SpirvMaxIdBound = 1u << 22;
+static const uint32_t OpEntryPoint = 15u;
+static const uint32_t OpExecutionMode = 16u;
+static const uint32_t OpTypeVoid = 19u;
+static const uint32_t OpTypeBool = 20u;
+static const uint32_t OpTypeInt = 21u;
+static const uint32_t OpTypeFloat = 22u;
+static const uint32_t OpTypeVector = 23u;
+static const uint32_t OpTypeMatrix = 24u;
+static const uint32_t OpTypeImage = 25u;
+static const uint32_t OpTypeSampler = 26u;
+static const uint32_t OpTypeSampledImage = 27u;
+static const uint32_t OpTypeArray = 28u;
+static const uint32_t OpTypeRuntimeArray = 29u;
+static const uint32_t OpTypeStruct = 30u;
+static const uint32_t OpTypePointer = 32u;
+static const uint32_t OpTypeForwardPointer = 39u;
+static const uint32_t OpConstantTrue = 41u;
+static const uint32_t OpConstant = 43u;
+static const uint32_t OpConstantComposite = 44u;
+static const uint32_t OpSpecConstantTrue = 48u;
+static const uint32_t OpSpecConstantFalse = 49u;
+static const uint32_t OpSpecConstant = 50u;
+static const uint32_t OpSpecConstantComposite = 51u;
+static const uint32_t OpVariable = 59u;
+static const uint32_t OpDecorate = 71u;
+static const uint32_t OpMemberDecorate = 72u;
+static const uint32_t DecorationSpecId = 1u;
+static const uint32_t DecorationBlock = 2u;
+static const uint32_t DecorationBufferBlock = 3u;
+static const uint32_t DecorationArrayStride = 6u;
+static const uint32_t DecorationBuiltIn = 11u;
+static const uint32_t DecorationBinding = 33u;
+static const uint32_t DecorationDescriptorSet = 34u;
+static const uint32_t DecorationOffset = 35u;
+static const uint32_t BuiltInWorkgroupSize = 25u;
+static const uint32_t ExecutionModeLocalSize = 17u;
+static const uint32_t StorageClassUniformConstant = 0u;
+static const uint32_t StorageClassUniform = 2u;
+static const uint32_t StorageClassPushConstant = 9u;
+static const uint32_t StorageClassStorageBuffer = 12u;
+static const uint32_t StorageClassPhysicalStorageBuffer = 5349u;
+static const uint32_t DimBuffer = 5u;
+static const uint32_t DimSubpassData = 6u;
+//入れ子の型をたどる深さの上限。壊れたモジュールで無限に再帰しないようにする。
+static const uint32_t MaxTypeDepth = 16u;
+
+//結果IDごとに、それを定義した命令と付けられたデコレーションを持つ
+struct SpirvId
+{
+	uint32_t opcode;
+	const uint32_t* instruction;
+	uint32_t length;
+	bool hasSet;
+	bool hasBinding;
+	bool hasSpecId;
+	bool bufferBlock;
+	bool workgroupSize;
+	uint32_t set;
+	uint32_t binding;
+	uint32_t specId;
+	uint32_t arrayStride;
+	//Offsetが付いていないメンバーはUINT32_MAX
+	vector<uint32_t> memberOffsets;
+};
+
+static uint32_t constantValue(const vector<SpirvId>& ids, uint32_t id)
+{
+	if (id >= ids.size() || ids[id].length < 4u)
+	{
+		return 0u;
+	}
+	const SpirvId& constant = ids[id];
+	return constant.opcode == OpConstant || constant.opcode == OpSpecConstant ? constant.instruction[3] : 0u;
+}
+
+//push_constantのブロックの大きさを求めるための型の大きさ。runtime arrayは0とする。
+static uint32_t typeSize(const vector<SpirvId>& ids, uint32_t typeId, uint32_t depth)
+{
+	if (typeId >= ids.size() || depth > MaxTypeDepth || ids[typeId].length < 2u)
+	{
+		return 0u;
+	}
+	const SpirvId& type = ids[typeId];
+	const uint32_t* in = type.instruction;
+	switch (type.opcode)
+	{
+	case OpTypeBool:
+		return 4u;
+	case OpTypeInt:
+	case OpTypeFloat:
+		return type.length >= 3u ? in[2] / 8u : 0u;
+	case OpTypeVector:
+	case OpTypeMatrix:
+		return type.length >= 4u ? typeSize(ids, in[2], depth + 1u) * in[3] : 0u;
+	case OpTypeArray:
+		if (type.length < 4u)
+		{
+			return 0u;
+		}
+		return (type.arrayStride != 0u ? type.arrayStride : typeSize(ids, in[2], depth + 1u)) * constantValue(ids, in[3]);
+	case OpTypeStruct:
+	{
+		uint32_t size = 0u;
+		for (uint32_t i = 2u; i < type.length; i++)
+		{
+			const uint32_t member = i - 2u;
+			const uint32_t offset = member < type.memberOffsets.size() && type.memberOffsets[member] != UINT32_MAX ? type.memberOffsets[member] : size;
+			size = max(size, offset + typeSize(ids, in[i], depth + 1u));
+		}
+		return size;
+	}
+	case OpTypePointer:
+		//buffer_referenceはpush_constantの中で64ビットのアドレスになる
+		return type.length >= 4u && in[2] == StorageClassPhysicalStorageBuffer ? 8u : 0u;
+	default:
+		return 0u;
+	}
+}
+
+//変数の型から配列を剥がしてデスクリプタの種類と個数を決める
+static bool descriptorType(const vector<SpirvId>& ids, uint32_t storageClass, uint32_t typeId, ShaderBinding& binding)
+{
+	binding.count = 1u;
+	for (uint32_t depth = 0; depth < MaxTypeDepth && typeId < ids.size(); depth++)
+	{
+		const SpirvId& type = ids[typeId];
+		const uint32_t* in = type.instruction;
+		if ((type.opcode == OpTypeArray || type.opcode == OpTypeRuntimeArray) && type.length >= 3u)
+		{
+			binding.count = type.opcode == OpTypeArray && type.length >= 4u ? constantValue(ids, in[3]) : 0u;
+			typeId = in[2];
+			continue;
+		}
+		switch (type.opcode)
+		{
+		case OpTypeStruct:
+			binding.descriptorType = storageClass == StorageClassStorageBuffer || type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			return true;
+		case OpTypeSampler:
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+			return true;
+		case OpTypeSampledImage:
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			return true;
+		case OpTypeImage:
+		{
+			if (type.length < 8u)
+			{
+				return false;
+			}
+			//Sampledが1ならサンプラーと組んで読むだけ、2ならストレージとして読み書きする
+			const uint32_t dim = in[3];
+			const bool sampled = in[7] == 1u;
+			if (dim == DimBuffer)
+			{
+				binding.descriptorType = sampled ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+			}
+			else if (dim == DimSubpassData)
+			{
+				binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			}
+			else
+			{
+				binding.descriptorType = sampled ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			}
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+	return false;
+}
+
+static VkShaderStageFlags executionModelStage(uint32_t executionModel)
+{
+	switch (executionModel)
+	{
+	case 0u:
+		return VK_SHADER_STAGE_VERTEX_BIT;
+	case 4u:
+		return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case 5u:
+		return VK_SHADER_STAGE_COMPUTE_BIT;
+	default:
+		return VK_SHADER_STAGE_ALL;
+	}
+}
+
+bool reflectSpirv(const uint32_t* words, size_t wordCount, ShaderInterface& shaderInterface, vector<const char*>& errors)
+{
+	shaderInterface = ShaderInterface{};
+	shaderInterface.localSize[0] = 1u;
+	shaderInterface.localSize[1] = 1u;
+	shaderInterface.localSize[2] = 1u;
+	if (words == nullptr || wordCount < SpirvHeaderWords || words[0] != SpirvMagicNumber)
+	{
+		errors.push_back("module is not SPIR-V in reflectSpirv");
+		return false;
+	}
+
+	//ヘッダーのBoundは全ての結果IDより大きい。IDは飛び飛びでもよいのでワード数とは比べられないが、
+	//壊れたヘッダーで巨大な表を取らないよう、実用上ありえない大きさは弾く。
+	if (words[3] > SpirvMaxIdBound)
+	{
+		errors.push_back("SPIR-V id bound is too large in reflectSpirv");
+		return false;
+	}
+	vector<SpirvId> ids(words[3]);
+	uint32_t entryPoint = UINT32_MAX;
+	uint32_t executionModel = UINT32_MAX;
+	for (size_t i = SpirvHeaderWords; i < wordCount;)
+	{
+		const uint32_t length = words[i] >> 16;
+		const uint32_t opcode = words[i] & 0xffffu;
+		if (length == 0u || i + length > wordCount)
+		{
+			errors.push_back("SPIR-V instruction overruns the module in reflectSpirv");
+			return false;
+		}
+		const uint32_t* in = words + i;
+		i += length;
+
+		if (opcode == OpEntryPoint)
+		{
+			if (entryPoint == UINT32_MAX && length >= 3u)
+			{
+				executionModel = in[1];
+				entryPoint = in[2];
+			}
+			continue;
+		}
+		if (opcode == OpExecutionMode)
+		{
+			if (length >= 6u && in[1] == entryPoint && in[2] == ExecutionModeLocalSize)
+			{
+				shaderInterface.localSize[0] = in[3];
+				shaderInterface.localSize[1] = in[4];
+				shaderInterface.localSize[2] = in[5];
+			}
+			continue;
+		}
+		if (opcode == OpDecorate)
+		{
+			if (length < 3u || in[1] >= ids.size())
+			{
+				continue;
+			}
+			SpirvId& target = ids[in[1]];
+			const uint32_t literal = length >= 4u ? in[3] : 0u;
+			switch (in[2])
+			{
+			case DecorationSpecId:
+				target.hasSpecId = true;
+				target.specId = literal;
+				break;
+			case DecorationDescriptorSet:
+				target.hasSet = true;
+				target.set = literal;
+				break;
+			case DecorationBinding:
+				target.hasBinding = true;
+				target.binding = literal;
+				break;
+			case DecorationBufferBlock:
+				target.bufferBlock = true;
+				break;
+			case DecorationArrayStride:
+				target.arrayStride = literal;
+				break;
+			case DecorationBuiltIn:
+				target.workgroupSize = literal == BuiltInWorkgroupSize;
+				break;
+			default:
+				break;
+			}
+			continue;
+		}
+		if (opcode == OpMemberDecorate)
+		{
+			if (length >= 5u && in[1] < ids.size() && in[3] == DecorationOffset)
+			{
+				vector<uint32_t>& offsets = ids[in[1]].memberOffsets;
+				if (offsets.size() <= in[2])
+				{
+					offsets.resize(size_t(in[2]) + 1u, UINT32_MAX);
+				}
+				offsets[in[2]] = in[4];
+			}
+			continue;
+		}
+
+		//型は1語目が、定数と変数は2語目が結果ID
+		uint32_t resultId = UINT32_MAX;
+		if (opcode >= OpTypeVoid && opcode <= OpTypeForwardPointer && length >= 2u)
+		{
+			resultId = in[1];
+		}
+		else if (((opcode >= OpConstantTrue && opcode <= OpSpecConstantComposite) || opcode == OpVariable) && length >= 3u)
+		{
+			resultId = in[2];
+		}
+		if (resultId < ids.size())
+		{
+			ids[resultId].opcode = opcode;
+			ids[resultId].instruction = in;
+			ids[resultId].length = length;
+		}
+	}
+	if (entryPoint == UINT32_MAX)
+	{
+		errors.push_back("SPIR-V has no entry point in reflectSpirv");
+		return false;
+	}
+	shaderInterface.stage = executionModelStage(executionModel);
+
+	for (const auto& id : ids)
+	{
+		const uint32_t* in = id.instruction;
+		if (id.opcode == OpVariable && id.length >= 4u && in[1] < ids.size() && ids[in[1]].opcode == OpTypePointer && ids[in[1]].length >= 4u)
+		{
+			const uint32_t storageClass = in[3];
+			const uint32_t pointeeType = ids[in[1]].instruction[3];
+			if (storageClass == StorageClassPushConstant)
+			{
+				shaderInterface.pushConstantSize = max(shaderInterface.pushConstantSize, typeSize(ids, pointeeType, 0u));
+				continue;
+			}
+			if (!id.hasBinding || (storageClass != StorageClassUniformConstant && storageClass != StorageClassUniform && storageClass != StorageClassStorageBuffer))
+			{
+				continue;
+			}
+			ShaderBinding binding{};
+			binding.set = id.hasSet ? id.set : 0u;
+			binding.binding = id.binding;
+			if (descriptorType(ids, storageClass, pointeeType, binding))
+			{
+				shaderInterface.bindings.push_back(binding);
+			}
+			continue;
+		}
+		if (id.hasSpecId && id.length >= 3u && (id.opcode == OpSpecConstant || id.opcode == OpSpecConstantTrue || id.opcode == OpSpecConstantFalse))
+		{
+			ShaderSpecConstant specConstant{};
+			specConstant.constantID = id.specId;
+			specConstant.size = id.opcode == OpSpecConstant ? typeSize(ids, in[1], 0u) : uint32_t(sizeof(VkBool32));
+			shaderInterface.specConstants.push_back(specConstant);
+			continue;
+		}
+		//gl_WorkGroupSizeを使っていれば、その定数がlocal_sizeの正しい値を持つ
+		if (id.workgroupSize && (id.opcode == OpConstantComposite || id.opcode == OpSpecConstantComposite) && id.length >= 6u)
+		{
+			for (uint32_t k = 0; k < 3u; k++)
+			{
+				shaderInterface.localSize[k] = constantValue(ids, in[3u + k]);
+			}
+		}
+	}
+
+	sort(shaderInterface.bindings.begin(), shaderInterface.bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b)
+	{
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	sort(shaderInterface.specConstants.begin(), shaderInterface.specConstants.end(), [](const ShaderSpecConstant& a, const ShaderSpecConstant& b)
+	{
+		return a.constantID < b.constantID;
+	});
+	return true;
+}
+
+uint32_t ShaderInterface::setCount() const
+{
+	uint32_t count = 0u;
+	for (const auto& binding : bindings)
+	{
+		count = max(count, binding.set + 1u);
+	}
+	return count;
+}
+
+bool ShaderInterface::hasSpecConstant(uint32_t constantID) const
+{
+	for (const auto& specConstant : specConstants)
+	{
+		if (specConstant.constantID == constantID)
+		{
+			return true;
+		}
+	}
+	return false;
+}
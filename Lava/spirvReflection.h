@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+using namespace std;
+
+//シェーダーが使うデスクリプタ1つ。countが0なら要素数を決めない配列(runtime array)。
+struct ShaderBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	uint32_t count;
+};
+
+//constant_idで値を差し込めるスペシャライゼーション定数
+struct ShaderSpecConstant
+{
+	uint32_t constantID;
+	uint32_t size;
+};
+
+//SPIR-Vのデコレーションから読み取ったシェーダーの外側との取り決め。
+//デスクリプタはsetとbindingの順に並べる。
+struct ShaderInterface
+{
+	VkShaderStageFlags stage;
+	vector<ShaderBinding> bindings;
+	uint32_t pushConstantSize;
+	vector<ShaderSpecConstant> specConstants;
+	uint32_t localSize[3];
+	//使われている中で最大のset+1
+	uint32_t setCount() const;
+	bool hasSpecConstant(uint32_t constantID) const;
+};
+
+//最初のエントリーポイントについて、binding, set, push_constantの大きさ, constant_id, local_sizeを読み取る。
+//SPIR-Vとして読めなければfalseを返し、エラーに積む。
+bool reflectSpirv(const uint32_t* words, size_t wordCount, ShaderInterface& shaderInterface, vector<const char*>& errors);
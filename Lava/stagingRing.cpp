@@ -0,0 +1,120 @@
+#include "stagingRing.h"
+
+StagingRing::StagingRing()
+{
+	allocator = VK_NULL_HANDLE;
+	buffer = VK_NULL_HANDLE;
+	allocation = VK_NULL_HANDLE;
+	mapped = nullptr;
+	size = 0u;
+	head = 0u;
+	tail = 0u;
+	empty = true;
+	pending = false;
+}
+
+void StagingRing::create(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation, VkDeviceSize size, vector<const char*>& errors)
+{
+	this->allocator = allocator;
+	this->buffer = buffer;
+	this->allocation = allocation;
+	this->size = size;
+	VmaAllocationInfo allocationInfo{};
+	vmaGetAllocationInfo(allocator, allocation, &allocationInfo);
+	mapped = static_cast<uint8_t*>(allocationInfo.pMappedData);
+	if (mapped == nullptr)
+	{
+		errors.push_back("staging buffer is not mapped in StagingRing::create");
+	}
+}
+
+//空きが足りなければfalseを返す。呼び出し側は完了を待ってreclaimしてからやり直す。
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation)
+{
+	if (mapped == nullptr || size == 0u || size > this->size)
+	{
+		return false;
+	}
+	if (alignment == 0u)
+	{
+		alignment = 1u;
+	}
+	if (empty)
+	{
+		head = 0u;
+		tail = 0u;
+	}
+
+	VkDeviceSize offset = (head + alignment - 1u) / alignment * alignment;
+	if (!empty && head <= tail)
+	{
+		//折り返した後は [head, tail) だけが空いている
+		if (offset + size > tail)
+		{
+			return false;
+		}
+	}
+	else if (offset + size > this->size)
+	{
+		//末尾に入らなければ先頭に折り返す。末尾の余りは次の解放までまとめて使用中扱いになる。
+		if (size > tail)
+		{
+			return false;
+		}
+		offset = 0u;
+	}
+
+	head = offset + size;
+	empty = false;
+	pending = true;
+
+	allocation.buffer = buffer;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.data = mapped + offset;
+	return true;
+}
+
+//書き込み後に呼ぶ。HOST_COHERENTでないメモリの場合だけVMAが実際にフラッシュする。
+void StagingRing::flush(const StagingAllocation& allocation)
+{
+	vmaFlushAllocation(allocator, this->allocation, allocation.offset, allocation.size);
+}
+
+//前回のretire以降に切り出した領域を、値valueのサブミットが使うものとして記録する。
+void StagingRing::retire(uint64_t value)
+{
+	if (!pending)
+	{
+		return;
+	}
+	inFlight.push_back({ head, value });
+	pending = false;
+}
+
+void StagingRing::reclaim(uint64_t completedValue)
+{
+	while (!inFlight.empty() && inFlight.front().value <= completedValue)
+	{
+		tail = inFlight.front().end;
+		inFlight.pop_front();
+	}
+	if (inFlight.empty() && !pending)
+	{
+		empty = true;
+	}
+}
+
+VkDeviceSize StagingRing::capacity() const
+{
+	return size;
+}
+
+VkDeviceSize StagingRing::usedBytes() const
+{
+	if (empty)
+	{
+		return 0u;
+	}
+	return head > tail ? head - tail : size - tail + head;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//ステージングリングから切り出した領域。dataに書き込み、bufferのoffsetからコピーする。
+struct StagingAllocation
+{
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void* data;
+};
+
+//永続的にマップしたステージングバッファをリングとして使う。
+//切り出した領域は、それを使うサブミットの値(フェンスの通し番号やタイムラインの値)を
+//retireで結び付け、その値が完了したことをreclaimで知らされるまで再利用しない。
+class StagingRing
+{
+public:
+	StagingRing();
+	void create(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation, VkDeviceSize size, vector<const char*>& errors);
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation);
+	void flush(const StagingAllocation& allocation);
+	void retire(uint64_t value);
+	void reclaim(uint64_t completedValue);
+	VkDeviceSize capacity() const;
+	VkDeviceSize usedBytes() const;
+private:
+	struct InFlight
+	{
+		VkDeviceSize end;
+		uint64_t value;
+	};
+	VmaAllocator allocator;
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	uint8_t* mapped;
+	VkDeviceSize size;
+	VkDeviceSize head;
+	VkDeviceSize tail;
+	bool empty;
+	bool pending;
+	deque<InFlight> inFlight;
+};
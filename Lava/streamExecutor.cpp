@@ -0,0 +1,190 @@
+#include "streamExecutor.h"
+
+//スロットごとに段ごとの開始と終了で2つずつ
+static const uint32_t QueriesPerSlot = StreamStageCount * 2u;
+
+StreamExecutor::StreamExecutor()
+{
+	device = VK_NULL_HANDLE;
+	allocator = VK_NULL_HANDLE;
+	size = 0u;
+	queryPool = VK_NULL_HANDLE;
+	timestampPeriod = 0.0;
+	timestampMask = 0u;
+	stats = {};
+}
+
+//chunkSizeはfloatの倍数で渡すこと。カーネルは要素数で範囲外を捨てるので、ワークグループに揃えなくてもスロットの外へは書かない。
+//descriptorSetLayoutがVK_NULL_HANDLEならスロットはセットを持たず、カーネルにはpush descriptorで渡す
+void StreamExecutor::create(VkDevice device, VmaAllocator allocator, DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, VkDeviceSize chunkSize, uint32_t depth, vector<const char*>& errors)
+{
+	this->device = device;
+	this->allocator = allocator;
+	size = chunkSize;
+	slots.resize(depth);
+	for (auto& slot : slots)
+	{
+		slot = StreamSlot{};
+		VmaAllocationCreateInfo chunkAllocInfo{};
+		chunkAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		VkBufferCreateInfo bufferCI{};
+		bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCI.pNext = nullptr;
+		bufferCI.flags = 0;
+		bufferCI.size = chunkSize;
+		bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCI.queueFamilyIndexCount = 0;
+		bufferCI.pQueueFamilyIndices = nullptr;
+		if (vmaCreateBuffer(allocator, &bufferCI, &chunkAllocInfo, &slot.buffer, &slot.allocation, nullptr) != VK_SUCCESS)
+		{
+			errors.push_back("vmaCreateBuffer failled in StreamExecutor::create");
+			continue;
+		}
+
+		//セットはdescriptorAllocatorのプールと一緒に破棄される。レイアウトが無ければセットを持たない。
+		if (descriptorSetLayout == VK_NULL_HANDLE || !descriptorAllocator.allocate(descriptorSetLayout, slot.descriptorSet))
+		{
+			continue;
+		}
+
+		//binding=0をスロットのバッファに結び付けたまま使い回す
+		VkDescriptorBufferInfo descriptorBufferInfo{};
+		descriptorBufferInfo.buffer = slot.buffer;
+		descriptorBufferInfo.offset = 0u;
+		descriptorBufferInfo.range = chunkSize;
+		VkWriteDescriptorSet writeDescriptorSet{};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.pNext = nullptr;
+		writeDescriptorSet.dstSet = slot.descriptorSet;
+		writeDescriptorSet.dstBinding = 0u;
+		writeDescriptorSet.dstArrayElement = 0u;
+		writeDescriptorSet.descriptorCount = 1u;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSet.pImageInfo = nullptr;
+		writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+		writeDescriptorSet.pTexelBufferView = nullptr;
+		vkUpdateDescriptorSets(device, 1u, &writeDescriptorSet, 0u, nullptr);
+	}
+	readbackBuffer.create(allocator, chunkSize, depth, errors);
+}
+
+//クエリのリセットはホストから行うので、hostQueryResetが有効な時だけ呼ぶこと
+void StreamExecutor::enableTimestamps(float timestampPeriod, uint32_t validBits, vector<const char*>& errors)
+{
+	if (validBits == 0u)
+	{
+		return;
+	}
+	VkQueryPoolCreateInfo queryPoolCI{};
+	queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCI.pNext = nullptr;
+	queryPoolCI.flags = 0u;
+	queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolCI.queryCount = uint32_t(slots.size()) * QueriesPerSlot;
+	queryPoolCI.pipelineStatistics = 0u;
+	if (vkCreateQueryPool(device, &queryPoolCI, nullptr, &queryPool) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateQueryPool is failed in StreamExecutor::enableTimestamps");
+		queryPool = VK_NULL_HANDLE;
+		return;
+	}
+	vkResetQueryPool(device, queryPool, 0u, queryPoolCI.queryCount);
+	this->timestampPeriod = timestampPeriod;
+	timestampMask = validBits >= 64u ? ~0ull : (1ull << validBits) - 1u;
+}
+
+void StreamExecutor::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	readbackBuffer.destroy();
+	for (auto& slot : slots)
+	{
+		if (slot.buffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(allocator, slot.buffer, slot.allocation);
+		}
+	}
+	slots.clear();
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(device, queryPool, nullptr);
+		queryPool = VK_NULL_HANDLE;
+	}
+	device = VK_NULL_HANDLE;
+}
+
+bool StreamExecutor::ready() const
+{
+	return device != VK_NULL_HANDLE;
+}
+
+uint32_t StreamExecutor::depth() const
+{
+	return uint32_t(slots.size());
+}
+
+VkDeviceSize StreamExecutor::chunkSize() const
+{
+	return size;
+}
+
+StreamSlot& StreamExecutor::slot(uint32_t index)
+{
+	return slots[index];
+}
+
+ReadbackBuffer& StreamExecutor::readback()
+{
+	return readbackBuffer;
+}
+
+void StreamExecutor::writeTimestamp(VkCommandBuffer commandBuffer, uint32_t slot, StreamStage stage, bool end, VkPipelineStageFlagBits pipelineStage)
+{
+	if (queryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	vkCmdWriteTimestamp(commandBuffer, pipelineStage, queryPool, slot * QueriesPerSlot + uint32_t(stage) * 2u + (end ? 1u : 0u));
+}
+
+void StreamExecutor::retire(uint32_t slot, VkDeviceSize size)
+{
+	slots[slot].downloadTicket = 0u;
+	stats.chunkCount++;
+	stats.bytes += size;
+	for (auto& stage : stats.stages)
+	{
+		stage.bytes += size;
+	}
+	if (queryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//ダウンロードが完了していれば、それが待っていた前の段も書き終わっている
+	uint64_t timestamps[QueriesPerSlot];
+	const VkResult result = vkGetQueryPoolResults(device, queryPool, slot * QueriesPerSlot, QueriesPerSlot, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_SUCCESS)
+	{
+		for (uint32_t i = 0; i < StreamStageCount; i++)
+		{
+			const uint64_t ticks = (timestamps[i * 2u + 1u] - timestamps[i * 2u]) & timestampMask;
+			stats.stages[i].milliseconds += double(ticks) * timestampPeriod / 1.0e6;
+		}
+		stats.timestamps = true;
+	}
+	vkResetQueryPool(device, queryPool, slot * QueriesPerSlot, QueriesPerSlot);
+}
+
+void StreamExecutor::resetReport()
+{
+	stats = {};
+}
+
+StreamReport& StreamExecutor::report()
+{
+	return stats;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "vk_mem_alloc.h"
+#include "readbackBuffer.h"
+#include "hostImport.h"
+#include "mappedFile.h"
+#include "descriptorAllocator.h"
+
+using namespace std;
+
+//ストリーミングの3段。タイムスタンプのクエリもこの順に並べる。
+enum class StreamStage
+{
+	Upload,
+	Compute,
+	Download,
+};
+static const uint32_t StreamStageCount = 3u;
+
+//段ごとに流したバイト数と、GPUがその段のコマンドを実行していた時間の合計
+struct StreamStageStats
+{
+	uint64_t bytes;
+	double milliseconds;
+};
+
+//stream()1回分の結果。タイムスタンプが使えなければ段ごとの時間は0のまま。
+struct StreamReport
+{
+	uint64_t chunkCount;
+	uint64_t bytes;
+	double wallMilliseconds;
+	bool timestamps;
+	StreamStageStats stages[StreamStageCount];
+};
+
+//ストリーミングの1チャンク分の置き場所。アップロード、カーネル、ダウンロードの順に使い回す。
+struct StreamSlot
+{
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	VkDescriptorSet descriptorSet;
+	VkDeviceSize size;
+	//このスロットを最後に読み戻したサブミットのチケット。0なら空いている。
+	uint64_t downloadTicket;
+	//チャンクの読み出し元と書き込み先。配列の途中か、ファイルの窓を指す。
+	const void* source;
+	void* destination;
+	//ファイルから流す時の窓。取り込めた窓はステージングリングと読み戻しの代わりにそのままコピーする。
+	MappedView inputView;
+	MappedView outputView;
+	ImportedBuffer importedInput;
+	ImportedBuffer importedOutput;
+};
+
+//チャンクN+1のアップロード、チャンクNのカーネル、チャンクN-1のダウンロードを同時に走らせるためのスロット一式。
+//サブミットの順序はVulkanBase::streamが組み、ここはスロットの資源と段ごとのタイムスタンプを持つ。
+class StreamExecutor
+{
+public:
+	StreamExecutor();
+	void create(VkDevice device, VmaAllocator allocator, DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, VkDeviceSize chunkSize, uint32_t depth, vector<const char*>& errors);
+	//timestampPeriodはナノ秒。validBitsが0なら計らない。
+	void enableTimestamps(float timestampPeriod, uint32_t validBits, vector<const char*>& errors);
+	void destroy();
+	bool ready() const;
+	uint32_t depth() const;
+	VkDeviceSize chunkSize() const;
+	StreamSlot& slot(uint32_t index);
+	ReadbackBuffer& readback();
+	void writeTimestamp(VkCommandBuffer commandBuffer, uint32_t slot, StreamStage stage, bool end, VkPipelineStageFlagBits pipelineStage);
+	//スロットのダウンロードが完了した後に呼び、段ごとの時間を集計してスロットを空ける
+	void retire(uint32_t slot, VkDeviceSize size);
+	void resetReport();
+	StreamReport& report();
+private:
+	VkDevice device;
+	VmaAllocator allocator;
+	VkDeviceSize size;
+	vector<StreamSlot> slots;
+	ReadbackBuffer readbackBuffer;
+	VkQueryPool queryPool;
+	double timestampPeriod;
+	uint64_t timestampMask;
+	StreamReport stats;
+};
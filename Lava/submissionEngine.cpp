@@ -0,0 +1,308 @@
+#include "submissionEngine.h"
+
+SubmissionEngine::SubmissionEngine()
+{
+	device = VK_NULL_HANDLE;
+	submitQueue = VK_NULL_HANDLE;
+	familyIndex = 0u;
+	commandPool = VK_NULL_HANDLE;
+	timeline = VK_NULL_HANDLE;
+	errors = nullptr;
+	lastSubmitted = 0u;
+	lastFlushed = 0u;
+	lastCompleted = 0u;
+	stats = {};
+	maxBatchJobs = 32u;
+	maxBatchMicroseconds = 200u;
+}
+
+void SubmissionEngine::create(VkDevice device, uint32_t queueFamilyIndex, VkQueue queue, vector<const char*>& errors)
+{
+	this->device = device;
+	this->errors = &errors;
+	submitQueue = queue;
+	familyIndex = queueFamilyIndex;
+
+	//コマンドバッファは完了したものから使い回すので、個別にリセットできるプールにする
+	VkCommandPoolCreateInfo commandPoolCI{};
+	commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCI.pNext = nullptr;
+	commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCI.queueFamilyIndex = queueFamilyIndex;
+	if (vkCreateCommandPool(device, &commandPoolCI, nullptr, &commandPool) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateCommandPool is failed in SubmissionEngine::create");
+	}
+
+	VkSemaphoreTypeCreateInfo semaphoreTypeCI{};
+	semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeCI.pNext = nullptr;
+	semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeCI.initialValue = 0u;
+	VkSemaphoreCreateInfo semaphoreCI{};
+	semaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCI.pNext = &semaphoreTypeCI;
+	semaphoreCI.flags = 0u;
+	if (vkCreateSemaphore(device, &semaphoreCI, nullptr, &timeline) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateSemaphore is failed in SubmissionEngine::create");
+	}
+}
+
+void SubmissionEngine::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	waitIdle();
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	vkDestroySemaphore(device, timeline, nullptr);
+	commandPool = VK_NULL_HANDLE;
+	timeline = VK_NULL_HANDLE;
+	freeCommandBuffers.clear();
+	inFlight.clear();
+	pending.clear();
+}
+
+VkCommandBuffer SubmissionEngine::begin()
+{
+	poll();
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	if (freeCommandBuffers.empty())
+	{
+		VkCommandBufferAllocateInfo commandBufferAllocInfo{};
+		commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferAllocInfo.pNext = nullptr;
+		commandBufferAllocInfo.commandPool = commandPool;
+		commandBufferAllocInfo.commandBufferCount = 1u;
+		commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			errors->push_back("vkAllocateCommandBuffers is failed in SubmissionEngine::begin");
+			return VK_NULL_HANDLE;
+		}
+	}
+	else
+	{
+		commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+	}
+
+	//RESET_COMMAND_BUFFER_BITのプールなので、vkBeginCommandBufferが前回の内容を暗黙にリセットする
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = VK_NULL_HANDLE;
+	if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+	{
+		errors->push_back("vkBeginCommandBuffer is failed in SubmissionEngine::begin");
+	}
+	return commandBuffer;
+}
+
+//記録を終えてバッチに積み、このジョブが完了するとタイムラインが到達する値を返す。失敗したら0。
+//maxBatchJobsに達するか、最初に積んだジョブからmaxBatchMicrosecondsが経っていればまとめて送る。
+uint64_t SubmissionEngine::submit(VkCommandBuffer commandBuffer, const vector<TimelineWait>& waits)
+{
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		errors->push_back("vkEndCommandBuffer is failed in SubmissionEngine::submit");
+		freeCommandBuffers.push_back(commandBuffer);
+		return 0u;
+	}
+	PendingSubmit job{};
+	job.commandBuffer = commandBuffer;
+	job.value = lastSubmitted + 1u;
+	for (const auto& wait : waits)
+	{
+		//自分のタイムラインで既に完了した値は待つ必要がない
+		if (wait.semaphore == timeline && wait.value <= lastCompleted)
+		{
+			continue;
+		}
+		job.waitSemaphores.push_back(wait.semaphore);
+		job.waitValues.push_back(wait.value);
+		job.waitStages.push_back(wait.stage);
+	}
+	if (pending.empty())
+	{
+		pendingSince = chrono::steady_clock::now();
+	}
+	pending.push_back(move(job));
+	lastSubmitted++;
+	inFlight.push_back({ commandBuffer, lastSubmitted });
+
+	if (pending.size() >= maxBatchJobs)
+	{
+		flushPending(stats.sizeFlushes);
+	}
+	else if (latencyExpired())
+	{
+		flushPending(stats.latencyFlushes);
+	}
+	return lastSubmitted;
+}
+
+void SubmissionEngine::flush()
+{
+	flushPending(stats.explicitFlushes);
+}
+
+bool SubmissionEngine::latencyExpired() const
+{
+	if (pending.empty())
+	{
+		return false;
+	}
+	const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - pendingSince);
+	return elapsed.count() >= maxBatchMicroseconds;
+}
+
+//溜まっているジョブを1回のvkQueueSubmitで送る。ジョブごとにタイムラインの自分の値を通知する。
+void SubmissionEngine::flushPending(uint64_t& reasonCounter)
+{
+	if (pending.empty())
+	{
+		return;
+	}
+	vector<VkTimelineSemaphoreSubmitInfo> timelineSubmitInfos(pending.size());
+	vector<VkSubmitInfo> submitInfos(pending.size());
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		const PendingSubmit& job = pending[i];
+		VkTimelineSemaphoreSubmitInfo& timelineSubmitInfo = timelineSubmitInfos[i];
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSubmitInfo.pNext = nullptr;
+		timelineSubmitInfo.waitSemaphoreValueCount = uint32_t(job.waitValues.size());
+		timelineSubmitInfo.pWaitSemaphoreValues = job.waitValues.data();
+		timelineSubmitInfo.signalSemaphoreValueCount = 1u;
+		timelineSubmitInfo.pSignalSemaphoreValues = &job.value;
+
+		VkSubmitInfo& submitInfo = submitInfos[i];
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = uint32_t(job.waitSemaphores.size());
+		submitInfo.pWaitSemaphores = job.waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = job.waitStages.data();
+		submitInfo.commandBufferCount = 1u;
+		submitInfo.pCommandBuffers = &job.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1u;
+		submitInfo.pSignalSemaphores = &timeline;
+	}
+	if (vkQueueSubmit(submitQueue, uint32_t(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		errors->push_back("vkQueueSubmit is failed in SubmissionEngine::flush");
+	}
+	const uint32_t jobs = uint32_t(pending.size());
+	stats.flushCount++;
+	stats.jobCount += jobs;
+	stats.lastFlushJobs = jobs;
+	if (jobs > stats.maxFlushJobs)
+	{
+		stats.maxFlushJobs = jobs;
+	}
+	reasonCounter++;
+	lastFlushed = pending.back().value;
+	pending.clear();
+}
+
+bool SubmissionEngine::isComplete(uint64_t ticket)
+{
+	if (ticket <= lastCompleted)
+	{
+		return true;
+	}
+	//まだ送っていないジョブは送らない限り完了しない
+	if (ticket > lastFlushed)
+	{
+		flush();
+	}
+	return poll() >= ticket;
+}
+
+void SubmissionEngine::wait(uint64_t ticket)
+{
+	if (ticket <= lastCompleted)
+	{
+		return;
+	}
+	if (ticket > lastFlushed)
+	{
+		flush();
+	}
+	VkSemaphoreWaitInfo semaphoreWaitInfo{};
+	semaphoreWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	semaphoreWaitInfo.pNext = nullptr;
+	semaphoreWaitInfo.flags = 0u;
+	semaphoreWaitInfo.semaphoreCount = 1u;
+	semaphoreWaitInfo.pSemaphores = &timeline;
+	semaphoreWaitInfo.pValues = &ticket;
+	vkWaitSemaphores(device, &semaphoreWaitInfo, UINT64_MAX);
+	poll();
+}
+
+void SubmissionEngine::waitIdle()
+{
+	wait(lastSubmitted);
+}
+
+uint64_t SubmissionEngine::poll()
+{
+	if (latencyExpired())
+	{
+		flushPending(stats.latencyFlushes);
+	}
+	uint64_t value = lastCompleted;
+	if (lastCompleted < lastFlushed && vkGetSemaphoreCounterValue(device, timeline, &value) == VK_SUCCESS && value > lastCompleted)
+	{
+		lastCompleted = value;
+	}
+	recycle();
+	return lastCompleted;
+}
+
+void SubmissionEngine::recycle()
+{
+	while (!inFlight.empty() && inFlight.front().value <= lastCompleted)
+	{
+		freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+		inFlight.pop_front();
+	}
+}
+
+TimelineWait SubmissionEngine::dependency(uint64_t ticket, VkPipelineStageFlags stage) const
+{
+	return { timeline, ticket, stage };
+}
+
+uint64_t SubmissionEngine::submittedValue() const
+{
+	return lastSubmitted;
+}
+
+uint64_t SubmissionEngine::completedValue() const
+{
+	return lastCompleted;
+}
+
+const SubmitBatchStats& SubmissionEngine::batchStats() const
+{
+	return stats;
+}
+
+VkSemaphore SubmissionEngine::semaphore() const
+{
+	return timeline;
+}
+
+VkQueue SubmissionEngine::queue() const
+{
+	return submitQueue;
+}
+
+uint32_t SubmissionEngine::queueFamilyIndex() const
+{
+	return familyIndex;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <chrono>
+
+using namespace std;
+
+//後続のサブミットが待つタイムラインの値。別のキューのセマフォも指定できる。
+struct TimelineWait
+{
+	VkSemaphore semaphore;
+	uint64_t value;
+	VkPipelineStageFlags stage;
+};
+
+//フラッシュ1回あたりに何個のジョブをまとめて送れたか
+struct SubmitBatchStats
+{
+	uint64_t flushCount;
+	uint64_t jobCount;
+	uint32_t lastFlushJobs;
+	uint32_t maxFlushJobs;
+	//フラッシュの理由ごとの回数
+	uint64_t sizeFlushes;
+	uint64_t latencyFlushes;
+	uint64_t explicitFlushes;
+};
+
+//1つのキューへのサブミットをタイムラインセマフォで管理する。
+//submitはサブミットごとに増えるタイムラインの値(チケット)を返し、
+//チケットは完了の問い合わせ、待機、後続のサブミットの依存に使える。ジョブごとのフェンスは持たない。
+//submitはすぐにはvkQueueSubmitせず、溜まったジョブをflushでVkSubmitInfoの配列として1回で送る。
+class SubmissionEngine
+{
+public:
+	SubmissionEngine();
+	void create(VkDevice device, uint32_t queueFamilyIndex, VkQueue queue, vector<const char*>& errors);
+	void destroy();
+	//空いているコマンドバッファを記録開始の状態で返す
+	VkCommandBuffer begin();
+	uint64_t submit(VkCommandBuffer commandBuffer, const vector<TimelineWait>& waits);
+	//溜まっているジョブを全て送る
+	void flush();
+	bool isComplete(uint64_t ticket);
+	void wait(uint64_t ticket);
+	void waitIdle();
+	//完了した値を問い合わせ直し、使い終わったコマンドバッファを回収する。待ち時間を過ぎたジョブはここでも送る。
+	uint64_t poll();
+	TimelineWait dependency(uint64_t ticket, VkPipelineStageFlags stage) const;
+	uint64_t submittedValue() const;
+	uint64_t completedValue() const;
+	const SubmitBatchStats& batchStats() const;
+	VkSemaphore semaphore() const;
+	VkQueue queue() const;
+	uint32_t queueFamilyIndex() const;
+	//これだけ溜まるか、最初のジョブからこれだけ経つと送る。1なら従来通りジョブごとに送る。
+	uint32_t maxBatchJobs;
+	uint32_t maxBatchMicroseconds;
+private:
+	struct InFlight
+	{
+		VkCommandBuffer commandBuffer;
+		uint64_t value;
+	};
+	struct PendingSubmit
+	{
+		VkCommandBuffer commandBuffer;
+		uint64_t value;
+		vector<VkSemaphore> waitSemaphores;
+		vector<uint64_t> waitValues;
+		vector<VkPipelineStageFlags> waitStages;
+	};
+	VkDevice device;
+	VkQueue submitQueue;
+	uint32_t familyIndex;
+	VkCommandPool commandPool;
+	VkSemaphore timeline;
+	vector<const char*>* errors;
+	uint64_t lastSubmitted;
+	uint64_t lastFlushed;
+	uint64_t lastCompleted;
+	vector<VkCommandBuffer> freeCommandBuffers;
+	deque<InFlight> inFlight;
+	vector<PendingSubmit> pending;
+	chrono::steady_clock::time_point pendingSince;
+	SubmitBatchStats stats;
+	void flushPending(uint64_t& reasonCounter);
+	bool latencyExpired() const;
+	void recycle();
+};
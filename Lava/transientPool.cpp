@@ -0,0 +1,136 @@
+#include "transientPool.h"
+
+TransientPool::TransientPool()
+{
+	allocator = VK_NULL_HANDLE;
+	pool = VK_NULL_HANDLE;
+	poolSize = 0u;
+	usage = 0u;
+	used = 0u;
+}
+
+//プールのメモリは最初に切り出す時に確保する。使わないキューのプールはメモリを持たない。
+void TransientPool::create(VmaAllocator allocator, VkDeviceSize poolSize, VkBufferUsageFlags usage, vector<const char*>& errors)
+{
+	this->allocator = allocator;
+	this->poolSize = poolSize;
+	this->usage = usage;
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	bufferCI.size = poolSize;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
+	VmaAllocationCreateInfo transientAllocInfo{};
+	transientAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	uint32_t memoryTypeIndex = 0u;
+	if (vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferCI, &transientAllocInfo, &memoryTypeIndex) != VK_SUCCESS)
+	{
+		errors.push_back("vmaFindMemoryTypeIndexForBufferInfo failled in TransientPool::create");
+		return;
+	}
+	//リングバッファとして使えるのはブロックが1つのプールだけ
+	VmaPoolCreateInfo poolCI{};
+	poolCI.memoryTypeIndex = memoryTypeIndex;
+	poolCI.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+	poolCI.blockSize = poolSize;
+	poolCI.minBlockCount = 0u;
+	poolCI.maxBlockCount = 1u;
+	if (vmaCreatePool(allocator, &poolCI, &pool) != VK_SUCCESS)
+	{
+		errors.push_back("vmaCreatePool failled in TransientPool::create");
+		pool = VK_NULL_HANDLE;
+	}
+}
+
+void TransientPool::destroy()
+{
+	if (pool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	reset();
+	vmaDestroyPool(allocator, pool);
+	pool = VK_NULL_HANDLE;
+}
+
+bool TransientPool::allocate(VkDeviceSize size, TransientBuffer& buffer)
+{
+	buffer = {};
+	if (pool == VK_NULL_HANDLE || size == 0u)
+	{
+		return false;
+	}
+	VmaAllocationCreateInfo transientAllocInfo{};
+	transientAllocInfo.pool = pool;
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	bufferCI.size = size;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
+	if (vmaCreateBuffer(allocator, &bufferCI, &transientAllocInfo, &buffer.buffer, &buffer.allocation, nullptr) != VK_SUCCESS)
+	{
+		buffer = {};
+		return false;
+	}
+	buffer.size = size;
+	pending.push_back(buffer);
+	used += size;
+	return true;
+}
+
+void TransientPool::retire(const TransientBuffer& buffer, uint64_t value)
+{
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		if (pending[i].buffer == buffer.buffer)
+		{
+			retired.push_back({ pending[i], value });
+			pending.erase(pending.begin() + i);
+			return;
+		}
+	}
+}
+
+void TransientPool::reclaim(uint64_t completedValue)
+{
+	while (!retired.empty() && retired.front().value <= completedValue)
+	{
+		release(retired.front().buffer);
+		retired.pop_front();
+	}
+}
+
+void TransientPool::reset()
+{
+	for (auto& buffer : pending)
+	{
+		release(buffer);
+	}
+	pending.clear();
+	reclaim(UINT64_MAX);
+}
+
+void TransientPool::release(TransientBuffer& buffer)
+{
+	vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+	used -= buffer.size;
+	buffer = {};
+}
+
+VkDeviceSize TransientPool::capacity() const
+{
+	return poolSize;
+}
+
+VkDeviceSize TransientPool::usedBytes() const
+{
+	return used;
+}
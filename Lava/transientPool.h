@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include "vk_mem_alloc.h"
+
+using namespace std;
+
+//TransientPoolから切り出した作業用バッファ。先頭からsizeバイトを使う。
+struct TransientBuffer
+{
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	VkDeviceSize size;
+};
+
+//1回のサブミットの間だけ使う作業用バッファを、VMA_POOL_CREATE_LINEAR_ALGORITHM_BITのプールから切り出す。
+//プールは1ブロックのリングバッファとして使い、切り出しは末尾を進めるだけで済む。
+//切り出したバッファはそれを使ったサブミットの値とretireで結び付け、reclaimでその値の完了を知らされた時にまとめて返す。
+//値は単調に増えるので、サブミットした順にretireすれば返す順は切り出した順と同じになり、プールは断片化しない。
+class TransientPool
+{
+public:
+	TransientPool();
+	void create(VmaAllocator allocator, VkDeviceSize poolSize, VkBufferUsageFlags usage, vector<const char*>& errors);
+	void destroy();
+	//プールに空きが無ければfalseを返す。エラーには積まないので、reclaimしてから取り直せる。
+	bool allocate(VkDeviceSize size, TransientBuffer& buffer);
+	//bufferを使うサブミットの値。同じプールには1つのタイムラインの値だけを渡すこと。
+	//retireしていないバッファは、サブミットが完了しても返さない。
+	void retire(const TransientBuffer& buffer, uint64_t value);
+	void reclaim(uint64_t completedValue);
+	//GPUがどのバッファも使っていない時に、全てまとめて返す
+	void reset();
+	VkDeviceSize capacity() const;
+	VkDeviceSize usedBytes() const;
+private:
+	struct Retired
+	{
+		TransientBuffer buffer;
+		uint64_t value;
+	};
+	VmaAllocator allocator;
+	VmaPool pool;
+	VkDeviceSize poolSize;
+	VkBufferUsageFlags usage;
+	vector<TransientBuffer> pending;
+	deque<Retired> retired;
+	VkDeviceSize used;
+	void release(TransientBuffer& buffer);
+};
@@ -1,4 +1,6 @@
 #define VMA_IMPLEMENTATION
 #define VMA_VULKAN_VERSION 1002000 // Vulkan 1.2
+#if defined(_WIN32) && !defined(LAVA_HEADLESS)
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include "vk_mem_alloc.h"
\ No newline at end of file
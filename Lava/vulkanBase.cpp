@@ -1,44 +1,271 @@
 #include "vulkanBase.h"
+#include "SPIR-V/add.comp.h"
+#include "SPIR-V/addAddress.comp.h"
+#include "SPIR-V/addBindless.comp.h"
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+//パイプラインキャッシュの保存先。SPIR-Vと同じくプロジェクトからの相対パス。
+static const char* PipelineCacheFileName = "../Lava/pipeline.cache";
+
+//addAddress.compのpush_constantと同じ並び。積むのはシェーダーが使う12バイトだけ。
+struct AddressParameters
+{
+	VkDeviceAddress outputData;
+	uint32_t elementCount;
+};
+
+//add.compのpush_constantと同じ並び。アリーナ版も同じものを積む。
+struct AddParameters
+{
+	uint32_t elementCount;
+};
+
+//addBindless.compのpush_constantと同じ並び
+struct BindlessParameters
+{
+	uint32_t bufferIndex;
+	uint32_t elementCount;
+	uint32_t elementOffset;
+};
+
+//WindowsではデバッガのOutputウィンドウへ、それ以外では標準エラーへ出力する
+static void debugOutput(const char* message)
+{
+#if defined(_WIN32)
+	OutputDebugStringA(message);
+#else
+	fputs(message, stderr);
+#endif
+}
 
 void VulkanBase::errorLog()
 {
 	if (errors.size())
 	{
-		OutputDebugStringA("=====Error=====\n");
+		debugOutput("=====Error=====\n");
 		for (const auto* i : errors)
 		{
-			OutputDebugStringA(i);
-			OutputDebugStringA("\n");
+			debugOutput(i);
+			debugOutput("\n");
 		}
-		OutputDebugStringA("===============\n");
+		debugOutput("===============\n");
 	}
 	else
 	{
-		OutputDebugStringA("=====Non Error=====\n");
+		debugOutput("=====Non Error=====\n");
+	}
+}
+
+void VulkanBase::startupLog()
+{
+	char line[256];
+	debugOutput("=====Startup=====\n");
+	snprintf(line, sizeof(line), "device: %s, score %llu, subgroup %u\n",
+		profile.properties.deviceName, (unsigned long long)profile.score(), profile.subgroupSize());
+	debugOutput(line);
+	snprintf(line, sizeof(line), "vkCreateInstance: %.3f ms, %zu bytes, extensions %u/%u\n",
+		startupReport.instanceMilliseconds, startupReport.instanceHostBytes,
+		startupReport.enabledInstanceExtensions, startupReport.advertisedInstanceExtensions);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "vkCreateDevice: %.3f ms, %zu bytes, extensions %u/%u\n",
+		startupReport.deviceMilliseconds, startupReport.deviceHostBytes,
+		startupReport.enabledDeviceExtensions, startupReport.advertisedDeviceExtensions);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "queue family: compute %u x%u, transfer %u:%u\n", queueFamilyIndex, uint32_t(computeQueues.size()), transferQueueFamilyIndex, transferQueueIndex);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "layouts: %u set, %u pipeline, %llu reused\n",
+		layoutCache.setLayoutCount(), layoutCache.pipelineLayoutCount(), (unsigned long long)layoutCache.hitCount());
+	debugOutput(line);
+	snprintf(line, sizeof(line), "descriptors: %s, %u pools\n", useDeviceAddress ? "device address" : useBindless ? "bindless" : addKernel.pushDescriptor() ? "push" : "update template", descriptorAllocator.poolCount());
+	debugOutput(line);
+	snprintf(line, sizeof(line), "memory pools: persistent %s, linear %llu bytes x%u\n", persistentPool != VK_NULL_HANDLE ? "yes" : "no",
+		(unsigned long long)transientPoolSize, uint32_t(transientPools.size()));
+	debugOutput(line);
+	snprintf(line, sizeof(line), "memory budget: %s, watermark %.2f\n", enabled.hasDeviceExtension("VK_EXT_memory_budget") ? "VK_EXT_memory_budget" : "estimated", residency.watermark);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "arena: %llu bytes/block, %llu bytes/array, align %llu\n",
+		(unsigned long long)arenaBlockSize, (unsigned long long)bufferArena.rangeLimit(), (unsigned long long)profile.limits().minStorageBufferOffsetAlignment);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "upload path: %s\n", deviceLocalBufferMapped != nullptr ? "zero-copy" : "staging");
+	debugOutput(line);
+	snprintf(line, sizeof(line), "driver host memory: %zu bytes now, %zu bytes peak\n",
+		hostMemoryTracker.currentBytes(), hostMemoryTracker.peakBytes());
+	debugOutput(line);
+	debugOutput("=================\n");
+}
+
+static void batchStatsLog(const char* queueName, const SubmitBatchStats& stats)
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%s flushes: %llu, jobs: %llu, %.2f jobs/flush, last %u, max %u\n", queueName,
+		(unsigned long long)stats.flushCount, (unsigned long long)stats.jobCount,
+		stats.flushCount != 0u ? double(stats.jobCount) / double(stats.flushCount) : 0.0, stats.lastFlushJobs, stats.maxFlushJobs);
+	debugOutput(line);
+	snprintf(line, sizeof(line), "%s flushed by size %llu, latency %llu, explicit %llu\n", queueName,
+		(unsigned long long)stats.sizeFlushes, (unsigned long long)stats.latencyFlushes, (unsigned long long)stats.explicitFlushes);
+	debugOutput(line);
+}
+
+void VulkanBase::submissionLog()
+{
+	debugOutput("=====Submission=====\n");
+	char queueName[32];
+	for (const auto& engine : queueEngines)
+	{
+		snprintf(queueName, sizeof(queueName), "queue %u%s", uint32_t(&engine - queueEngines.data()), &engine == transferEngine ? " (transfer)" : "");
+		batchStatsLog(queueName, engine.batchStats());
 	}
+	debugOutput("====================\n");
 }
 
 VulkanBase::VulkanBase()
 {
+	instance = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+	debugMessenger = VK_NULL_HANDLE;
+	startupReport = {};
+	stagingBufferSize = 64u << 20;
+	deviceLocalBufferSize = 1024u;
+	readbackBufferSize = 4u << 20;
+	readbackSlotCount = 2u;
+	enableZeroCopy = true;
+	maxBatchJobs = 32u;
+	maxBatchMicroseconds = 200u;
+	enableTransferQueue = true;
+	enablePushDescriptor = true;
+	enableBufferDeviceAddress = false;
+	addressShaderModule = VK_NULL_HANDLE;
+	useDeviceAddress = false;
+	enableBindless = false;
+	bindlessBufferCapacity = 16384u;
+	bindlessImageCapacity = 1024u;
+	bindlessShaderModule = VK_NULL_HANDLE;
+	useBindless = false;
+	deviceLocalBufferHandle = BindlessInvalidHandle;
+	importedInputHandle = BindlessInvalidHandle;
+	arenaBlockSize = 64u << 20;
+	arenaRangeLimit = 1u << 20;
+	arenaSetLayout = VK_NULL_HANDLE;
+	arenaBindlessRange = 0u;
+	transientPoolSize = 8u << 20;
+	persistentPool = VK_NULL_HANDLE;
+	residencyWatermark = 0.9f;
+	defragmentBytesPerPass = 16u << 20;
+	defragmentAllocationsPerPass = 64u;
+	transferEngine = nullptr;
+	transferQueueShared = true;
+	deviceLocalBufferOwner = nullptr;
+	deviceLocalBufferMapped = nullptr;
+	importedInput = {};
+	streamChunkSize = 16u << 20;
+	streamDepth = 3u;
+}
 
+#if !defined(LAVA_HEADLESS)
+bool VulkanBase::initialize(GLFWwindow* window, const char* appTitle, const VulkanCapabilities& capabilities)
+{
+	VulkanCapabilities windowCapabilities = capabilities;
+	//ウィンドウに描画するためにGLFWが必要とする拡張
+	{
+		uint32_t count = 0u;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			windowCapabilities.requiredInstanceExtensions.push_back(glfwExtensions[i]);
+		}
+	}
+	return initialize(appTitle, windowCapabilities);
 }
+#endif
 
-void VulkanBase::initialize(GLFWwindow* window, const char* appTitle)
+//ウィンドウもサーフェスも作らない計算専用の初期化。WSIの拡張は要求しない。
+//使えるGPUが無いかデバイスを作れなければ、そこまでのエラーを出力してfalseを返す。
+bool VulkanBase::initialize(const char* appTitle, const VulkanCapabilities& capabilities)
 {
+	this->capabilities = capabilities;
+	//サブミットの完了はタイムラインセマフォで追う
+	this->capabilities.requiredFeatures12.timelineSemaphore = VK_TRUE;
+	//stream()の段ごとのタイムスタンプをホストからリセットするため。無ければ時間を計らない。
+	this->capabilities.optionalFeatures12.hostQueryReset = VK_TRUE;
+	//どちらもcompute()でのバッファの渡し方なので、両方が指定されたらアドレスを使いbindlessは作らない
+	if (enableBufferDeviceAddress && enableBindless)
+	{
+		errors.push_back("enableBufferDeviceAddress and enableBindless are exclusive in initialize");
+		enableBindless = false;
+	}
+	if (enableBufferDeviceAddress)
+	{
+		this->capabilities.optionalFeatures12.bufferDeviceAddress = VK_TRUE;
+	}
+	if (enableBindless)
+	{
+		//添字はpush_constantから読むのでnonuniformは要らず、動的に一様な添字で引ければよい
+		this->capabilities.optionalFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		this->capabilities.optionalFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+		this->capabilities.optionalFeatures12.runtimeDescriptorArray = VK_TRUE;
+		this->capabilities.optionalFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+		this->capabilities.optionalFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		this->capabilities.optionalFeatures12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		this->capabilities.optionalFeatures12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+	}
 	createInstance(appTitle);
-	selectPhysicalDevices();
-	createDevice();
+	createDebugMessenger();
+	if (!selectPhysicalDevices() || !createDevice())
+	{
+		errorLog();
+		return false;
+	}
+	createPipelineCache(PipelineCacheFileName);
 	createMemoryAllocator();
 	createStagingBuffer();
 	createDeviceLocalBuffer();
-	createCommandPool();
-	createCommandBuffer();
-	createFence();
-	shaderModule = createShaderModule("../Lava/SPIR-V/add.comp.spv");
+	createReadbackBuffer();
+	createHostImporter();
+	createSubmissionEngine();
+	createMemoryPools();
+	createResidencyManager();
+	//組み込みのカーネルは実行ファイルに埋め込んだSPIR-Vから作る
+	SpirvBinary addSpirv;
+	addSpirv.assign(AddCompSpirv);
+	shaderModule = createShaderModule(addSpirv);
+	//レイアウトはSPIR-Vのデコレーションから作る
+	reflectSpirv(addSpirv.words(), addSpirv.wordCount(), addInterface, errors);
+	layoutCache.create(device);
 	createDescriptorPool();
 	createDescriptorSetLayout();
-	createDescriptorSet();
+	createComputeKernel();
+	createAddressKernel();
+	createBindlessKernel();
+	createBufferArena();
 	errorLog();
+	startupLog();
+	return true;
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types, const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void* userData)
+{
+	debugOutput(callbackData->pMessage);
+	debugOutput("\n");
+	return VK_FALSE;
+}
+
+static void fillDebugMessengerCI(VkDebugUtilsMessengerCreateInfoEXT& debugMessengerCI)
+{
+	debugMessengerCI = {};
+	debugMessengerCI.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	debugMessengerCI.pNext = nullptr;
+	debugMessengerCI.flags = 0u;
+	debugMessengerCI.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	debugMessengerCI.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	debugMessengerCI.pfnUserCallback = debugMessengerCallback;
+	debugMessengerCI.pUserData = nullptr;
+}
+
+static double elapsedMilliseconds(chrono::steady_clock::time_point begin)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
 }
 
 void VulkanBase::createInstance(const char* appTitle)
@@ -52,42 +279,95 @@ void VulkanBase::createInstance(const char* appTitle)
 	applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 	applicationInfo.apiVersion = VK_API_VERSION_1_2;
 
-	vector<const char*> layers 
+	//検証レイヤーはデバッグ時にのみ要求する
+	vector<const char*> layers;
+	if (capabilities.enableValidation)
 	{
-		"VK_LAYER_KHRONOS_validation"
-	};
+		uint32_t count = 0u;
+		vkEnumerateInstanceLayerProperties(&count, nullptr);
+		vector<VkLayerProperties> layerProps(count);
+		vkEnumerateInstanceLayerProperties(&count, layerProps.data());
+		for (const auto& v : layerProps)
+		{
+			if (strcmp(v.layerName, "VK_LAYER_KHRONOS_validation") == 0)
+			{
+				layers.push_back("VK_LAYER_KHRONOS_validation");
+			}
+		}
+		if (layers.empty())
+		{
+			errors.push_back("VK_LAYER_KHRONOS_validation is not available in createInstance");
+		}
+	}
 
-	vector<const char*> extensions;
-	vector<VkExtensionProperties> properties;
+	vector<VkExtensionProperties>& properties = enabled.availableInstanceExtensions;
 	{
 		uint32_t count;
 		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
 		properties.resize(count);
 		vkEnumerateInstanceExtensionProperties(nullptr, &count, properties.data());
+	}
 
+	vector<const char*> optionalExtensions = capabilities.optionalInstanceExtensions;
+	if (capabilities.enableValidation)
+	{
+		optionalExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
+	if (capabilities.enableAllExtensions)
+	{
 		for (const auto& v : properties)
 		{
-			extensions.push_back(v.extensionName);
+			optionalExtensions.push_back(v.extensionName);
 		}
 	}
+	if (!selectExtensions(properties, capabilities.requiredInstanceExtensions, optionalExtensions, enabled.instanceExtensions))
+	{
+		errors.push_back("Required instance extension is not supported in createInstance");
+	}
+
+	VkDebugUtilsMessengerCreateInfoEXT debugMessengerCI{};
+	fillDebugMessengerCI(debugMessengerCI);
 
 	VkInstanceCreateInfo instanceCI{};
 	instanceCI.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	instanceCI.pNext = nullptr;
+	//vkCreateInstance/vkDestroyInstance中のメッセージも拾う
+	instanceCI.pNext = enabled.hasInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME) ? &debugMessengerCI : nullptr;
 	instanceCI.flags = 0;
 	instanceCI.pApplicationInfo = &applicationInfo;
 	instanceCI.enabledLayerCount = uint32_t(layers.size());
 	instanceCI.ppEnabledLayerNames = layers.data();
-	instanceCI.enabledExtensionCount = uint32_t(extensions.size());
-	instanceCI.ppEnabledExtensionNames = extensions.data();
+	instanceCI.enabledExtensionCount = uint32_t(enabled.instanceExtensions.size());
+	instanceCI.ppEnabledExtensionNames = enabled.instanceExtensions.data();
 
-	if (vkCreateInstance(&instanceCI, nullptr, &instance) != VK_SUCCESS)
+	const size_t hostBytes = hostMemoryTracker.currentBytes();
+	const auto begin = chrono::steady_clock::now();
+	if (vkCreateInstance(&instanceCI, hostMemoryTracker.callbacks(), &instance) != VK_SUCCESS)
 	{
 		errors.push_back("Create instance failed");
 	}
+	startupReport.instanceMilliseconds = elapsedMilliseconds(begin);
+	startupReport.instanceHostBytes = hostMemoryTracker.currentBytes() - hostBytes;
+	startupReport.advertisedInstanceExtensions = uint32_t(properties.size());
+	startupReport.enabledInstanceExtensions = uint32_t(enabled.instanceExtensions.size());
+}
+
+void VulkanBase::createDebugMessenger()
+{
+	debugMessenger = VK_NULL_HANDLE;
+	if (!enabled.hasInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME))
+	{
+		return;
+	}
+	auto pfnCreateDebugUtilsMessenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+	VkDebugUtilsMessengerCreateInfoEXT debugMessengerCI{};
+	fillDebugMessengerCI(debugMessengerCI);
+	if (pfnCreateDebugUtilsMessenger == nullptr || pfnCreateDebugUtilsMessenger(instance, &debugMessengerCI, nullptr, &debugMessenger) != VK_SUCCESS)
+	{
+		errors.push_back("vkCreateDebugUtilsMessengerEXT is failed in createDebugMessenger");
+	}
 }
 
-void VulkanBase::selectPhysicalDevices()
+bool VulkanBase::selectPhysicalDevices()
 {
 
 	{
@@ -98,41 +378,60 @@ void VulkanBase::selectPhysicalDevices()
 	}
 
 	//Confirm GPU supporting for Vulkan
-	for (const auto& pDevice : physicalDevices)
-	{
-		VkPhysicalDeviceProperties2 props{};
-		VkPhysicalDeviceVulkan11Properties props11{};
-		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-		props.pNext = &props11;
-		props11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
-		props11.pNext = nullptr;
-		vkGetPhysicalDeviceProperties2(pDevice, &props); 
-		VkPhysicalDeviceFeatures2 features;
-		VkPhysicalDeviceVulkan11Features features11;
-		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-		features.pNext = &features11;
-		features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
-		features11.pNext = nullptr;
-		vkGetPhysicalDeviceFeatures2(pDevice, &features);
+	deviceProfiles.resize(physicalDevices.size());
+	for (size_t i = 0; i < physicalDevices.size(); i++)
+	{
+		queryDeviceProfile(physicalDevices[i], deviceProfiles[i]);
 	}
 
 	//Select GPU
-	physicalDevice = physicalDevices[0];
+	size_t selected = deviceProfiles.size();
+	if (capabilities.deviceOverride != nullptr)
+	{
+		for (size_t i = 0; i < deviceProfiles.size(); i++)
+		{
+			//指定されても、Vulkan 1.2の計算ができないGPUは選ばない
+			if (deviceProfiles[i].matches(capabilities.deviceOverride) && deviceProfiles[i].score() > 0u)
+			{
+				selected = i;
+				break;
+			}
+		}
+		if (selected == deviceProfiles.size())
+		{
+			errors.push_back("deviceOverride does not match any usable physical device in selectPhysicalDevices");
+		}
+	}
+	if (selected == deviceProfiles.size())
+	{
+		uint64_t bestScore = 0u;
+		for (size_t i = 0; i < deviceProfiles.size(); i++)
+		{
+			if (deviceProfiles[i].score() > bestScore)
+			{
+				bestScore = deviceProfiles[i].score();
+				selected = i;
+			}
+		}
+	}
+	if (selected == deviceProfiles.size())
+	{
+		errors.push_back("No physical device supports Vulkan 1.2 compute in selectPhysicalDevices");
+		physicalDevice = VK_NULL_HANDLE;
+		return false;
+	}
+	physicalDevice = physicalDevices[selected];
+	profile = deviceProfiles[selected];
+	return true;
 }
 
-void VulkanBase::createDevice()
+bool VulkanBase::createDevice()
 {
-	vector<VkQueueFamilyProperties> queueProps;
-	//GPUɔĂL[𒲂ׂB
-	{   
-		uint32_t queuePropCount;
-		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queuePropCount, nullptr);
-		queueProps.resize(queuePropCount);
-		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queuePropCount, queueProps.data());
-	}
+	//GPUに備わっているキューはプロファイル作成時に調べてある。
+	const vector<VkQueueFamilyProperties>& queueProps = profile.queueFamilies;
 
-	queueFamilyIndex = 0u;
-	//z̒]GPUL[t@~[(ėpvZ)IB
+	queueFamilyIndex = uint32_t(queueProps.size());
+	//配列の中から望むGPUキューファミリー(汎用計算)を選択。
 	for (uint32_t i = 0; i < queueProps.size(); i++)
 	{
 		if (queueProps[i].queueFlags & VkQueueFlagBits::VK_QUEUE_COMPUTE_BIT)
@@ -141,18 +440,60 @@ void VulkanBase::createDevice()
 			break;
 		}
 	}
+	if (queueFamilyIndex == uint32_t(queueProps.size()))
+	{
+		errors.push_back("No queue family supports compute in createDevice");
+		return false;
+	}
+
+	//転送はCOMPUTEもGRAPHICSも持たないファミリー(DMAエンジン)があればそちらで行い、計算と重ねる。
+	//無ければ計算ファミリーの2本目のキューを使い、それも無ければ同じキューで行う。
+	//計算ファミリーのキューは全て作り、QueueSchedulerで独立したジョブを振り分ける
+	const uint32_t computeQueueCount = queueProps[queueFamilyIndex].queueCount;
+	transferQueueFamilyIndex = queueFamilyIndex;
+	transferQueueIndex = 0u;
+	if (enableTransferQueue)
+	{
+		for (uint32_t i = 0; i < queueProps.size(); i++)
+		{
+			const VkQueueFlags flags = queueProps[i].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT)))
+			{
+				transferQueueFamilyIndex = i;
+				break;
+			}
+		}
+		//転送専用ファミリーが無ければ、計算ファミリーの最後のキューを転送に回す
+		if (transferQueueFamilyIndex == queueFamilyIndex && computeQueueCount > 1u)
+		{
+			transferQueueIndex = computeQueueCount - 1u;
+		}
+	}
 
-	const float priority = 0.0f;
+	vector<float> priorities(computeQueueCount);
+	for (uint32_t i = 0; i < computeQueueCount; i++)
+	{
+		priorities[i] = computeQueuePriority(i);
+	}
+	const float transferPriority = 0.5f;
+	vector<VkDeviceQueueCreateInfo> devQueueCIs;
 	VkDeviceQueueCreateInfo devQueueCI{};
 	devQueueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	devQueueCI.pNext = nullptr;
 	devQueueCI.flags = 0;
 	devQueueCI.queueFamilyIndex = queueFamilyIndex;
-	devQueueCI.queueCount = 1;
-	devQueueCI.pQueuePriorities = &priority;
+	devQueueCI.queueCount = computeQueueCount;
+	devQueueCI.pQueuePriorities = priorities.data();
+	devQueueCIs.push_back(devQueueCI);
+	if (transferQueueFamilyIndex != queueFamilyIndex)
+	{
+		devQueueCI.queueFamilyIndex = transferQueueFamilyIndex;
+		devQueueCI.queueCount = 1u;
+		devQueueCI.pQueuePriorities = &transferPriority;
+		devQueueCIs.push_back(devQueueCI);
+	}
 
-	vector<const char*> extension;
-	vector<VkExtensionProperties> devExtensionProps;
+	vector<VkExtensionProperties>& devExtensionProps = enabled.availableDeviceExtensions;
 	{
 		uint32_t count = 0;
 		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
@@ -160,271 +501,2325 @@ void VulkanBase::createDevice()
 		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, devExtensionProps.data());
 	}
 
-	for (const auto& v : devExtensionProps)
+	vector<const char*> optionalExtensions = capabilities.optionalDeviceExtensions;
+	//ポータビリティ実装では公開されていれば有効にする義務がある
+	optionalExtensions.push_back("VK_KHR_portability_subset");
+	//ホストの配列をコピーせずに取り込むため。無ければステージングリングを使う。
+	optionalExtensions.push_back("VK_EXT_external_memory_host");
+	//VMAがヒープの使用量と予算をドライバーから読むため。無ければVMAが自分の確保から見積もる。
+	optionalExtensions.push_back("VK_EXT_memory_budget");
+	//ジョブごとのデスクリプタセットの確保と更新を省くため。無ければ更新テンプレートでセットを書く。
+	if (enablePushDescriptor)
+	{
+		optionalExtensions.push_back("VK_KHR_push_descriptor");
+	}
+	if (capabilities.enableAllExtensions)
+	{
+		for (const auto& v : devExtensionProps)
+		{
+			optionalExtensions.push_back(v.extensionName);
+		}
+	}
+	if (!selectExtensions(devExtensionProps, capabilities.requiredDeviceExtensions, optionalExtensions, enabled.deviceExtensions))
+	{
+		errors.push_back("Required device extension is not supported in createDevice");
+	}
+
+	//要求された機能のうち対応しているものだけを有効にする
+	//対応している機能はプロファイルに保持してある
+	//機能の構造体はsTypeとpNextの後ろから最後のメンバーまでをVkBool32の配列として扱う。
+	//Vulkan12Featuresは末尾に詰め物が入るので、数は構造体の大きさではなく最後のメンバーの位置から数える。
+	//ヘッダーがVkBool32以外のメンバーを挟んだら、ここで止めて個別に合わせるよう直すこと。
+	constexpr size_t featureCount = sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32);
+	constexpr size_t feature11Offset = offsetof(VkPhysicalDeviceVulkan11Features, storageBuffer16BitAccess);
+	constexpr size_t feature11Count = (offsetof(VkPhysicalDeviceVulkan11Features, shaderDrawParameters) - feature11Offset) / sizeof(VkBool32) + 1u;
+	constexpr size_t feature12Offset = offsetof(VkPhysicalDeviceVulkan12Features, samplerMirrorClampToEdge);
+	constexpr size_t feature12Count = (offsetof(VkPhysicalDeviceVulkan12Features, subgroupBroadcastDynamicId) - feature12Offset) / sizeof(VkBool32) + 1u;
+	static_assert(sizeof(VkPhysicalDeviceFeatures) % sizeof(VkBool32) == 0u && featureCount == 55u, "VkPhysicalDeviceFeatures is not 55 VkBool32");
+	static_assert((offsetof(VkPhysicalDeviceVulkan11Features, shaderDrawParameters) - feature11Offset) % sizeof(VkBool32) == 0u && feature11Count == 12u,
+		"VkPhysicalDeviceVulkan11Features is not 12 VkBool32 after pNext");
+	static_assert((offsetof(VkPhysicalDeviceVulkan12Features, subgroupBroadcastDynamicId) - feature12Offset) % sizeof(VkBool32) == 0u && feature12Count == 47u,
+		"VkPhysicalDeviceVulkan12Features is not 47 VkBool32 after pNext");
+	auto fields = [](auto& features, size_t offset)
 	{
-		extension.push_back(v.extensionName);
+		return reinterpret_cast<VkBool32*>(reinterpret_cast<char*>(&features) + offset);
+	};
+	bool featuresSatisfied = mergeFeatures(
+		&capabilities.requiredFeatures.robustBufferAccess, &capabilities.optionalFeatures.robustBufferAccess,
+		&profile.features.robustBufferAccess, &enabled.features.features.robustBufferAccess, featureCount);
+	featuresSatisfied &= mergeFeatures(
+		fields(capabilities.requiredFeatures11, feature11Offset), fields(capabilities.optionalFeatures11, feature11Offset),
+		fields(profile.features11, feature11Offset), fields(enabled.features11, feature11Offset), feature11Count);
+	featuresSatisfied &= mergeFeatures(
+		fields(capabilities.requiredFeatures12, feature12Offset), fields(capabilities.optionalFeatures12, feature12Offset),
+		fields(profile.features12, feature12Offset), fields(enabled.features12, feature12Offset), feature12Count);
+	if (!featuresSatisfied)
+	{
+		errors.push_back("Required device feature is not supported in createDevice");
 	}
+	enabled.link();
 
 	VkDeviceCreateInfo devCI{};
 	devCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	devCI.pNext = nullptr;
+	devCI.pNext = &enabled.features;
 	devCI.flags = 0;
-	devCI.queueCreateInfoCount = 1;
-	devCI.pQueueCreateInfos = &devQueueCI;
+	devCI.queueCreateInfoCount = uint32_t(devQueueCIs.size());
+	devCI.pQueueCreateInfos = devQueueCIs.data();
 	devCI.enabledLayerCount = 0;
 	devCI.ppEnabledLayerNames = nullptr;
-	devCI.enabledExtensionCount = uint32_t(extension.size());
-	devCI.ppEnabledExtensionNames = extension.data();
+	devCI.enabledExtensionCount = uint32_t(enabled.deviceExtensions.size());
+	devCI.ppEnabledExtensionNames = enabled.deviceExtensions.data();
 	devCI.pEnabledFeatures = nullptr;
-	
-	if (vkCreateDevice(physicalDevice, &devCI, nullptr, &device) != VK_SUCCESS)
+
+	const size_t hostBytes = hostMemoryTracker.currentBytes();
+	const auto begin = chrono::steady_clock::now();
+	if (vkCreateDevice(physicalDevice, &devCI, hostMemoryTracker.callbacks(), &device) != VK_SUCCESS)
 	{
 		errors.push_back("Create device failed");
+		device = VK_NULL_HANDLE;
+		return false;
+	}
+	startupReport.deviceMilliseconds = elapsedMilliseconds(begin);
+	startupReport.deviceHostBytes = hostMemoryTracker.currentBytes() - hostBytes;
+	startupReport.advertisedDeviceExtensions = uint32_t(devExtensionProps.size());
+	startupReport.enabledDeviceExtensions = uint32_t(enabled.deviceExtensions.size());
+	computeQueues.resize(computeQueueCount);
+	for (uint32_t i = 0; i < computeQueueCount; i++)
+	{
+		vkGetDeviceQueue(device, queueFamilyIndex, i, &computeQueues[i]);
+	}
+	queue = computeQueues[0];
+	vkGetDeviceQueue(device, transferQueueFamilyIndex, transferQueueIndex, &transferQueue);
+	return true;
+}
+
+float VulkanBase::computeQueuePriority(uint32_t queueIndex) const
+{
+	if (queueIndex < computeQueuePriorities.size())
+	{
+		return computeQueuePriorities[queueIndex];
+	}
+	return queueIndex == 0u ? 1.0f : 0.5f;
+}
+
+//キャッシュファイルの先頭に付けるヘッダー。
+//VkPipelineCacheのヘッダーにはドライバーのバージョンが含まれないため、独自に持たせる。
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+};
+
+static const uint32_t PipelineCacheMagic = 0x4350564cu; //"LVPC"
+
+//ディスクのキャッシュを読み込んでVkPipelineCacheを作る。デバイスやドライバーが違えば空のキャッシュから始める。
+void VulkanBase::createPipelineCache(const char* fileName)
+{
+	vector<char> data;
+	ifstream file(fileName, ios::in | ios::binary | ios::ate);
+	if (file.good())
+	{
+		const streamoff fileSize = file.tellg();
+		PipelineCacheFileHeader header{};
+		if (fileSize >= streamoff(sizeof(header)))
+		{
+			file.seekg(0, ios::beg);
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			const bool valid =
+				header.magic == PipelineCacheMagic &&
+				header.vendorID == profile.properties.vendorID &&
+				header.deviceID == profile.properties.deviceID &&
+				header.driverVersion == profile.properties.driverVersion &&
+				memcmp(header.pipelineCacheUUID, profile.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+				header.dataSize == uint64_t(fileSize) - sizeof(header);
+			if (valid)
+			{
+				data.resize(size_t(header.dataSize));
+				file.read(data.data(), streamsize(data.size()));
+				if (!file.good())
+				{
+					data.clear();
+				}
+			}
+		}
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCI{};
+	pipelineCacheCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCI.pNext = nullptr;
+	pipelineCacheCI.flags = 0u;
+	pipelineCacheCI.initialDataSize = data.size();
+	pipelineCacheCI.pInitialData = data.empty() ? nullptr : data.data();
+	if (vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipelineCache) != VK_SUCCESS)
+	{
+		//ドライバーに拒否された場合は空のキャッシュで作り直す
+		pipelineCacheCI.initialDataSize = 0u;
+		pipelineCacheCI.pInitialData = nullptr;
+		if (vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipelineCache) != VK_SUCCESS)
+		{
+			pipelineCache = VK_NULL_HANDLE;
+			errors.push_back("vkCreatePipelineCache is failed in createPipelineCache");
+		}
+	}
+}
+
+//VkPipelineCacheの内容をディスクに書き戻す。書き込み途中のファイルを他のプロセスが読まないよう一時ファイルを経由する。
+void VulkanBase::savePipelineCache(const char* fileName)
+{
+	if (pipelineCache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	size_t dataSize = 0u;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0u)
+	{
+		return;
+	}
+	vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		errors.push_back("vkGetPipelineCacheData is failed in savePipelineCache");
+		return;
+	}
+
+	PipelineCacheFileHeader header{};
+	header.magic = PipelineCacheMagic;
+	header.vendorID = profile.properties.vendorID;
+	header.deviceID = profile.properties.deviceID;
+	header.driverVersion = profile.properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, profile.properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+
+	const string tempFileName = string(fileName) + ".tmp";
+	{
+		ofstream file(tempFileName, ios::out | ios::binary | ios::trunc);
+		if (!file.good())
+		{
+			errors.push_back("opening pipeline cache file is failed in savePipelineCache");
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), streamsize(dataSize));
+		if (!file.good())
+		{
+			errors.push_back("writing pipeline cache file is failed in savePipelineCache");
+			return;
+		}
+	}
+	remove(fileName);
+	if (rename(tempFileName.c_str(), fileName) != 0)
+	{
+		errors.push_back("renaming pipeline cache file is failed in savePipelineCache");
 	}
 }
 
 void VulkanBase::createMemoryAllocator()
 {
-	//AP[^
+	//アロケータを作る
 	VmaAllocatorCreateInfo allocatorCI{};
 	allocatorCI.instance = instance;
 	allocatorCI.physicalDevice = physicalDevice;
 	allocatorCI.device = device;
+	allocatorCI.vulkanApiVersion = VK_API_VERSION_1_2;
+	//バッファのデバイスアドレスを取れるよう、メモリをVK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BITで確保させる
+	if (enabled.features12.bufferDeviceAddress == VK_TRUE)
+	{
+		allocatorCI.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+	}
+	if (enabled.hasDeviceExtension("VK_EXT_memory_budget"))
+	{
+		allocatorCI.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+	}
 	if (vmaCreateAllocator(&allocatorCI, &allocator) != VK_SUCCESS)
 	{
 		errors.push_back("vmaCreateAllocator failled in createStagingBuffer");
 	}
 }
 
-//CPUGPU郁CBCPURs[ꂽf[^GPUGPUVRAMɃRs[B
+//CPUからもGPUからも見えるメインメモリ。CPUからコピーされたデータをGPUがGPUのVRAMにコピーする。
 void VulkanBase::createStagingBuffer()
 {
-	//Xe[WOobt@
+	//ステージングバッファを作る
 	VmaAllocationCreateInfo stagingBufferAllocInfo{};
-	stagingBufferAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU; //CPUGPU郁ŁAGPUɏł́B
+	stagingBufferAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU; //CPUとGPUが見れるメモリで、GPUが高速に処理できるもの。
+	stagingBufferAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT; //リングとして使うので最初から最後までマップしておく
 	VkBufferCreateInfo bufferCI{};
 	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferCI.pNext = nullptr;
 	bufferCI.flags = 0;
-	bufferCI.size = 1024u;
-	bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT || VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferCI.size = stagingBufferSize;
+	bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCI.queueFamilyIndexCount = 0;
 	bufferCI.pQueueFamilyIndices = nullptr;
 	if (vmaCreateBuffer(allocator, &bufferCI, &stagingBufferAllocInfo, &stagingBuffer, &stagingBufferAllocation, nullptr) != VK_SUCCESS)
 	{
 		errors.push_back("vmaCreateBuffer failled in createStagingBuffer");
+		return;
 	}
+	stagingRing.create(allocator, stagingBuffer, stagingBufferAllocation, stagingBufferSize, errors);
 }
 
-//GPÛ݌郁CBCPURs[ꂽf[^GPUGPUVRAMɃRs[B
+//GPUからのみ見えるメインメモリ。CPUからコピーされたデータをGPUがGPUのVRAMにコピーする。
 void VulkanBase::createDeviceLocalBuffer()
 {
-	//foCX[Jobt@
+	//デバイスローカルバッファを作る
 	VmaAllocationCreateInfo deviceLocalBufferAllocInfo{};
-	deviceLocalBufferAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY; //CPUGPU郁ŁAGPUɏł́B
+	deviceLocalBufferAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY; //CPUとGPUが見れるメモリで、GPUが高速に処理できるもの。
 	VkBufferCreateInfo bufferCI{};
 	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferCI.pNext = nullptr;
 	bufferCI.flags = 0;
-	bufferCI.size = 1024u;
-	bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT || VK_BUFFER_USAGE_TRANSFER_DST_BIT || VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferCI.size = deviceLocalBufferSize;
+	bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage();
 	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCI.queueFamilyIndexCount = 0;
 	bufferCI.pQueueFamilyIndices = nullptr;
+	if (enableZeroCopy && profile.prefersZeroCopy())
+	{
+		//ホストから見えるデバイスローカルメモリに置き、マップしたまま直接書き込む
+		VmaAllocationCreateInfo zeroCopyAllocInfo{};
+		zeroCopyAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		zeroCopyAllocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		zeroCopyAllocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		VmaAllocationInfo allocationInfo{};
+		if (vmaCreateBuffer(allocator, &bufferCI, &zeroCopyAllocInfo, &deviceLocalBuffer, &deviceLocalBufferAllocation, &allocationInfo) == VK_SUCCESS)
+		{
+			deviceLocalBufferMapped = allocationInfo.pMappedData;
+			return;
+		}
+		//ヒープが埋まっているなどで取れなければ、通常のデバイスローカルメモリに戻す
+	}
 	if (vmaCreateBuffer(allocator, &bufferCI, &deviceLocalBufferAllocInfo, &deviceLocalBuffer, &deviceLocalBufferAllocation, nullptr) != VK_SUCCESS)
 	{
 		errors.push_back("vmaCreateBuffer failled in createDeviceLocalBuffer");
 	}
 }
 
-//R}hobt@蓖Ă邽߂̃R}hv[B
-void VulkanBase::createCommandPool()
+//キューごとのサブミットを受け持つ。コマンドプールとタイムラインセマフォはこの中で作る。
+//転送に回したキューを除いた計算キューをスケジューラーに渡す。
+void VulkanBase::createSubmissionEngine()
 {
-	VkCommandPoolCreateInfo commandPoolCI{};
-	commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolCI.pNext = nullptr;
-	commandPoolCI.flags = 0u;
-	commandPoolCI.queueFamilyIndex = queueFamilyIndex;
-	if (vkCreateCommandPool(device, &commandPoolCI, nullptr, &commandPool) != VK_SUCCESS)
+	const bool dedicatedTransferFamily = transferQueueFamilyIndex != queueFamilyIndex;
+	const uint32_t computeQueueCount = uint32_t(computeQueues.size());
+	//エンジンを指すポインタを保持するので、作った後に要素数を変えないこと
+	queueEngines.resize(computeQueueCount + (dedicatedTransferFamily ? 1u : 0u));
+	vector<SubmissionEngine*> schedulerEngines;
+	vector<float> schedulerPriorities;
+	for (uint32_t i = 0; i < computeQueueCount; i++)
+	{
+		queueEngines[i].maxBatchJobs = maxBatchJobs;
+		queueEngines[i].maxBatchMicroseconds = maxBatchMicroseconds;
+		queueEngines[i].create(device, queueFamilyIndex, computeQueues[i], errors);
+		if (!dedicatedTransferFamily && i != 0u && i == transferQueueIndex)
+		{
+			continue;
+		}
+		schedulerEngines.push_back(&queueEngines[i]);
+		schedulerPriorities.push_back(computeQueuePriority(i));
+	}
+	if (dedicatedTransferFamily)
+	{
+		SubmissionEngine& engine = queueEngines.back();
+		engine.maxBatchJobs = maxBatchJobs;
+		engine.maxBatchMicroseconds = maxBatchMicroseconds;
+		engine.create(device, transferQueueFamilyIndex, transferQueue, errors);
+		transferEngine = &engine;
+	}
+	else
 	{
-		errors.push_back("vkCreateCommandPool is failed in createCommandPool");
+		transferEngine = &queueEngines[transferQueueIndex];
 	}
+	transferQueueShared = !dedicatedTransferFamily && transferQueueIndex == 0u;
+	scheduler.create(schedulerEngines, schedulerPriorities);
+	deviceLocalBufferOwner = &queueEngines[0];
 }
 
-void VulkanBase::createCommandBuffer()
+//用途ごとにVMAのプールを分ける。長く持つバッファは普通のプールに、ジョブの間だけ使う作業用バッファはキューごとの線形プールに置き、
+//作業用バッファの確保と解放が長く持つバッファの間に穴を空けないようにする。
+void VulkanBase::createMemoryPools()
 {
-	VkCommandBufferAllocateInfo commandBufferAllocInfo{};
-	commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferAllocInfo.pNext = nullptr;
-	commandBufferAllocInfo.commandPool = commandPool;
-	commandBufferAllocInfo.commandBufferCount = 1u;
-	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer) != VK_SUCCESS)
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage();
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.pNext = nullptr;
+	bufferCI.flags = 0;
+	bufferCI.size = 1024u;
+	bufferCI.usage = usage;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
+	VmaAllocationCreateInfo persistentAllocInfo{};
+	persistentAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	uint32_t memoryTypeIndex = 0u;
+	if (vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferCI, &persistentAllocInfo, &memoryTypeIndex) != VK_SUCCESS)
+	{
+		errors.push_back("vmaFindMemoryTypeIndexForBufferInfo failled in createMemoryPools");
+	}
+	else
+	{
+		//ブロックの大きさと数はVMAに任せる
+		VmaPoolCreateInfo poolCI{};
+		poolCI.memoryTypeIndex = memoryTypeIndex;
+		poolCI.flags = 0u;
+		poolCI.blockSize = 0u;
+		poolCI.minBlockCount = 0u;
+		poolCI.maxBlockCount = 0u;
+		if (vmaCreatePool(allocator, &poolCI, &persistentPool) != VK_SUCCESS)
+		{
+			errors.push_back("vmaCreatePool failled in createMemoryPools");
+			persistentPool = VK_NULL_HANDLE;
+		}
+	}
+	transientPools.resize(queueEngines.size());
+	for (auto& transientPool : transientPools)
 	{
-		errors.push_back("vkAllocateCommandBuffers is failed in createCommandBuffer");
+		transientPool.create(allocator, transientPoolSize, usage, errors);
 	}
 }
 
-void VulkanBase::copyBuffer()
+TransientPool& VulkanBase::transientBuffers(const SubmissionEngine& engine)
+{
+	return transientPools[size_t(&engine - queueEngines.data())];
+}
+
+//engineに積むジョブの作業用バッファを切り出す。ジョブをサブミットしたら、その値をretireTransientに渡すこと。
+bool VulkanBase::allocateTransient(SubmissionEngine& engine, VkDeviceSize size, TransientBuffer& buffer)
 {
-	VkCommandBufferBeginInfo commandBufferBeginInfo{};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	commandBufferBeginInfo.pNext = nullptr;
-	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	commandBufferBeginInfo.pInheritanceInfo = VK_NULL_HANDLE;
-	if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+	if (transientBuffers(engine).allocate(size, buffer))
 	{
-		errors.push_back("vkBeginCommandBuffer is failed in recordCommand");
+		return true;
 	}
-	VkBufferCopy region{};
-	region.srcOffset = 0u;
-	region.dstOffset = 0u;
-	region.size = 1000u;
-	vkCmdCopyBuffer(commandBuffer, stagingBuffer, deviceLocalBuffer, 1u, &region);
-	vkEndCommandBuffer(commandBuffer);
+	//空きが無ければ実行中のサブミットの完了を待って解放してから取り直す
+	waitQueue();
+	if (!transientBuffers(engine).allocate(size, buffer))
+	{
+		errors.push_back("transient pool is exhausted in allocateTransient");
+		return false;
+	}
+	return true;
+}
+
+//valueが完了したらbufferをプールへ返す。サブミットに失敗して値が0なら、次のreclaimで返す。
+void VulkanBase::retireTransient(SubmissionEngine& engine, const TransientBuffer& buffer, uint64_t value)
+{
+	transientBuffers(engine).retire(buffer, value);
 }
 
-void VulkanBase::createFence()
+//計算と転送のキューで持ち主を移さずに使うバッファを作る時のファミリー
+vector<uint32_t> VulkanBase::sharedQueueFamilyIndices() const
 {
-	VkFenceCreateInfo fenceCI{};
-	fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCI.pNext = nullptr;
-	fenceCI.flags = 0u;
-	if (vkCreateFence(device, &fenceCI, nullptr, &fence) != VK_SUCCESS)
+	vector<uint32_t> queueFamilyIndices = { queueFamilyIndex };
+	if (transferQueueFamilyIndex != queueFamilyIndex)
 	{
-		errors.push_back("vkCreateFence is failed");
+		queueFamilyIndices.push_back(transferQueueFamilyIndex);
 	}
+	return queueFamilyIndices;
 }
 
-void VulkanBase::flowQueue(VkQueue queue)
+void VulkanBase::createResidencyManager()
 {
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext = nullptr;
-	submitInfo.waitSemaphoreCount = 0u;
-	submitInfo.pWaitSemaphores = nullptr;
-	submitInfo.pWaitDstStageMask = nullptr;
-	submitInfo.commandBufferCount = 1u;
-	submitInfo.pCommandBuffers = &commandBuffer;
-	submitInfo.signalSemaphoreCount = 0u;
-	submitInfo.pSignalSemaphores = nullptr;
-	if (vkQueueSubmit(queue, 1u, &submitInfo, fence))
+	residency.watermark = residencyWatermark;
+	residency.create(allocator, persistentPool, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage(), sharedQueueFamilyIndices(), profile.memoryProperties, errors);
+}
+
+//予算を取り直し、incomingバイトを置いてもwatermarkに収まるまで、excludeを除く古いバッファをホストへ追い出す。
+//デバイス側の実体は追い出しのコピーが終わってから破棄されるので、使用量はその後で下がる。
+void VulkanBase::evictColdBuffers(uint32_t exclude, VkDeviceSize incoming)
+{
+	residency.updateBudgets();
+	const VkDeviceSize excess = residency.excessBytes(incoming);
+	VkDeviceSize evicted = 0u;
+	ResidencyMove move{};
+	while (evicted < excess && residency.beginEvict(exclude, move))
 	{
-		errors.push_back("vkQueueSubmit is failed");
+		moveResident(move);
+		evicted += move.size;
 	}
 }
 
-VkShaderModule VulkanBase::createShaderModule(const char* fileName)
+//追い出しや戻しのコピーを転送キューに積む。バッファを最後に使ったサブミットを待ってから読む。
+uint64_t VulkanBase::moveResident(const ResidencyMove& move)
 {
-	fstream file(fileName, ios::in | ios::binary);
-	if (!file.good())
+	VkCommandBuffer commandBuffer = transferEngine->begin();
+	copyBuffer(commandBuffer, move.srcBuffer, 0u, move.dstBuffer, 0u, move.size);
+	vector<TimelineWait> waits;
+	if (residency.ticket(move.handle) != 0u)
 	{
-		errors.push_back("opening spv file is failed in createShaderModule");
+		waits.push_back(dependency(residency.ticket(move.handle), *transferEngine, VK_PIPELINE_STAGE_TRANSFER_BIT));
 	}
-	vector<uint8_t>code;
-	code.assign(
-		istreambuf_iterator<char>(file),
-		istreambuf_iterator<char>()
-	);
-	VkShaderModuleCreateInfo shaderModuleCI{};
-	shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCI.pNext = nullptr;
-	shaderModuleCI.flags = 0u;
-	shaderModuleCI.codeSize = code.size();
-	shaderModuleCI.pCode = reinterpret_cast<const uint32_t*>(code.data());
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &shaderModuleCI, nullptr, &shaderModule) != VK_SUCCESS)
+	const uint64_t ticket = makeTicket(*transferEngine, flowQueue(*transferEngine, commandBuffer, waits));
+	residency.endMove(move, ticket);
+	//前のバッファを指す添字を使うサブミットはコピーが待っているので、コピーの完了で外せる
+	if (move.handle < uint32_t(residentBindings.size()) && residentBindings[move.handle].handle != BindlessInvalidHandle)
 	{
-		errors.push_back("vkCreateShaderModule is failed in createShaderModule");
+		bindlessTable.retireBuffer(residentBindings[move.handle].handle, ticket);
+		residentBindings[move.handle].handle = BindlessInvalidHandle;
 	}
-	return shaderModule;
+	return ticket;
 }
 
-void VulkanBase::createDescriptorPool()
+//カーネルの結果を受け取るホスト側のバッファ。スロットを交互に使う。
+void VulkanBase::createReadbackBuffer()
+{
+	readbackBuffer.create(allocator, readbackBufferSize, readbackSlotCount, errors);
+}
+
+void VulkanBase::createHostImporter()
+{
+	hostImporter.create(physicalDevice, device, profile.memoryProperties, enabled.hasDeviceExtension("VK_EXT_external_memory_host"));
+}
+
+//転送キューで記録する。転送キューが計算キューと同じならカーネルとの順序もここでバリアを張り、
+//別のキューならカーネルとの受け渡しはacquireDeviceLocalBufferの解放と獲得、セマフォに任せる。
+void VulkanBase::copyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
 {
-	VkDescriptorPoolSize descriptorPoolSize{};
-	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorPoolSize.descriptorCount = 5u;
+	const bool sharedQueue = transferQueueShared;
+	//先に積まれたカーネルや転送が読み書きし終えるまで上書きしない
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = sharedQueue ? VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = dstBuffer;
+	bufferMemoryBarrier.offset = dstOffset;
+	bufferMemoryBarrier.size = size;
+	vkCmdPipelineBarrier(commandBuffer, engineStages(*transferEngine), VK_PIPELINE_STAGE_TRANSFER_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
 
-	VkDescriptorPoolCreateInfo descriptorPoolCI{};
-	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolCI.pNext = nullptr;
-	descriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-	descriptorPoolCI.maxSets = 10u;
-	descriptorPoolCI.poolSizeCount = 1u;
-	descriptorPoolCI.pPoolSizes = &descriptorPoolSize;
-	if (vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool) != VK_SUCCESS)
+	VkBufferCopy region{};
+	region.srcOffset = srcOffset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1u, &region);
+	if (!sharedQueue)
 	{
-		errors.push_back("vkCreateDescriptorPool is failed in createDescriptorPool");
+		return;
 	}
+
+	//コピーの書き込みを後続のカーネルから見えるようにする
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
 }
 
-void VulkanBase::createDescriptorSetLayout()
+//先に積まれたカーネルと転送の書き込みを待ってdstBufferへコピーし、ホストから読めるようにする。copyBufferと同じく転送キューで記録する。
+void VulkanBase::readBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize size)
+{
+	const bool sharedQueue = transferQueueShared;
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = sharedQueue ? VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = srcBuffer;
+	bufferMemoryBarrier.offset = srcOffset;
+	bufferMemoryBarrier.size = size;
+	vkCmdPipelineBarrier(commandBuffer, engineStages(*transferEngine), VK_PIPELINE_STAGE_TRANSFER_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+
+	VkBufferCopy region{};
+	region.srcOffset = srcOffset;
+	region.dstOffset = 0u;
+	region.size = size;
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1u, &region);
+
+	//コピーの書き込みをホストの読み出しから見えるようにする
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferMemoryBarrier.buffer = dstBuffer;
+	bufferMemoryBarrier.offset = 0u;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+}
+
+//記録を終えたcommandBufferをwaitsの完了を待つようにengineのキューへサブミットし、完了するタイムラインの値を返す。
+//作業用バッファを使ったなら、呼び出し側がこの値をretireTransientに渡す。
+uint64_t VulkanBase::flowQueue(SubmissionEngine& engine, VkCommandBuffer commandBuffer, const vector<TimelineWait>& waits)
 {
-	//KvȃfXNv^w
-	VkDescriptorSetLayoutBinding descriptorSetLayoutBinding{};
-	//binding=0Ɍѕt
-	descriptorSetLayoutBinding.binding = 0;
-	descriptorSetLayoutBinding.descriptorCount = 1u;
-	descriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorSetLayoutBinding.pImmutableSamplers = nullptr;
-	descriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	return engine.submit(commandBuffer, waits);
+}
+
+//チケットの上位8ビットにどのキューのタイムラインかを入れる。先頭のキューなら値そのまま。
+static const uint32_t TicketQueueShift = 56u;
+static const uint64_t TicketValueMask = (1ull << TicketQueueShift) - 1u;
 
-	//fXNv^ZbgCAEg
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
-	descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorSetLayoutCI.flags = 0u;
-	descriptorSetLayoutCI.pNext = nullptr;
-	descriptorSetLayoutCI.bindingCount = 1u;
-	descriptorSetLayoutCI.pBindings = &descriptorSetLayoutBinding;
-	if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+uint64_t VulkanBase::makeTicket(const SubmissionEngine& engine, uint64_t value) const
+{
+	if (value == 0u)
 	{
-		errors.push_back("vkCreateDescriptorSetLayout is failed in createDescriptorSetLayout");
+		return 0u;
 	}
+	return value | (uint64_t(&engine - queueEngines.data()) << TicketQueueShift);
+}
+
+SubmissionEngine& VulkanBase::ticketEngine(uint64_t ticket)
+{
+	return queueEngines[size_t(ticket >> TicketQueueShift)];
 }
 
-void VulkanBase::createDescriptorSet()
+bool VulkanBase::ticketCompleted(uint64_t ticket)
 {
-	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	descriptorSetAllocInfo.pNext = nullptr;
-	descriptorSetAllocInfo.descriptorPool = descriptorPool;
-	descriptorSetAllocInfo.descriptorSetCount = 1u;
-	descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-	if (vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet) != VK_SUCCESS)
+	return ticketEngine(ticket).completedValue() >= (ticket & TicketValueMask);
+}
+
+//waiterへのサブミットがticketの完了を待つための依存。別のキューのチケットなら、そのキューに溜まっている分を先に送る。
+TimelineWait VulkanBase::dependency(uint64_t ticket, SubmissionEngine& waiter, VkPipelineStageFlags stage)
+{
+	SubmissionEngine& engine = ticketEngine(ticket);
+	if (&engine != &waiter)
 	{
-		errors.push_back("vkAllocateDescriptorSets is failled in createDescriptorSet");
+		engine.flush();
 	}
-	//쐬fXNv^Zbg̓fXNv^ZbgCAEgȂg܂킹B
+	return engine.dependency(ticket & TicketValueMask, stage);
 }
 
-void VulkanBase::updateDescriptorSet()
+VkPipelineStageFlags VulkanBase::engineStages(const SubmissionEngine& engine) const
 {
-	//XVfXNv^̓e
-	VkDescriptorBufferInfo descriptorBufferInfo{};
-	descriptorBufferInfo.buffer = deviceLocalBuffer;
-	descriptorBufferInfo.offset = 0u;
-	descriptorBufferInfo.range = 1024u;
+	if (profile.queueFamilies[engine.queueFamilyIndex()].queueFlags & VK_QUEUE_COMPUTE_BIT)
+	{
+		return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	return VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
 
-	//fXNv^̓eXV
-	VkWriteDescriptorSet writeDescriptorSet{};
-	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet.pNext = nullptr;
-	writeDescriptorSet.dstSet = descriptorSet; //̃fXNv^Zbg
-	writeDescriptorSet.dstBinding = 0u; //binding=0
-	writeDescriptorSet.dstArrayElement = 0u; //0Ԗڂ
-	writeDescriptorSet.descriptorCount = 1u; //1
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; //Xg[Wobt@̃fXNv^
-	writeDescriptorSet.pImageInfo = nullptr;
-	writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
-	writeDescriptorSet.pTexelBufferView = nullptr;
+//engineのキューでdeviceLocalBufferを使う前に、記録を始めたばかりのcommandBufferへ呼ぶ。
+//持ち主が別のファミリーなら元のキューで解放してcommandBufferで獲得し、同じファミリーの別のキューならセマフォで待つだけにする。
+//返した依存はcommandBufferのサブミットに渡すこと。
+vector<TimelineWait> VulkanBase::acquireDeviceLocalBuffer(VkCommandBuffer commandBuffer, SubmissionEngine& engine)
+{
+	vector<TimelineWait> waits;
+	SubmissionEngine& owner = *deviceLocalBufferOwner;
+	if (&owner == &engine)
+	{
+		return waits;
+	}
+	deviceLocalBufferOwner = &engine;
+	const VkPipelineStageFlags dstStages = engineStages(engine);
+	if (owner.queueFamilyIndex() == engine.queueFamilyIndex())
+	{
+		owner.flush();
+		waits.push_back(owner.dependency(owner.submittedValue(), dstStages));
+		return waits;
+	}
 
-	vkUpdateDescriptorSets(device, 1u, &writeDescriptorSet, 0u, nullptr);
+	const VkAccessFlags ownerAccess = (engineStages(owner) & VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) ? VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+	const VkAccessFlags engineAccess = (engineStages(engine) & VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) ? VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = ownerAccess;
+	bufferMemoryBarrier.dstAccessMask = 0u;
+	bufferMemoryBarrier.srcQueueFamilyIndex = owner.queueFamilyIndex();
+	bufferMemoryBarrier.dstQueueFamilyIndex = engine.queueFamilyIndex();
+	bufferMemoryBarrier.buffer = deviceLocalBuffer;
+	bufferMemoryBarrier.offset = 0u;
+	bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+
+	//元のキューでの解放。dstAccessMaskは無視されるので0にする。
+	VkCommandBuffer releaseCommandBuffer = owner.begin();
+	vkCmdPipelineBarrier(releaseCommandBuffer, engineStages(owner), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+	const uint64_t released = owner.submit(releaseCommandBuffer, vector<TimelineWait>());
+	owner.flush();
+	waits.push_back(owner.dependency(released, dstStages));
+
+	//こちらのキューでの獲得。srcAccessMaskは無視されるので0にする。
+	bufferMemoryBarrier.srcAccessMask = 0u;
+	bufferMemoryBarrier.dstAccessMask = engineAccess;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+	return waits;
 }
 
-void VulkanBase::terminate()
+//サブミット済みの全ての完了を待ち、使っていたステージング領域を解放する。
+void VulkanBase::waitQueue()
+{
+	for (auto& engine : queueEngines)
+	{
+		engine.waitIdle();
+		jobDescriptors(engine).reclaim(engine.completedValue());
+		transientBuffers(engine).reclaim(engine.completedValue());
+	}
+	stagingRing.reclaim(transferEngine->completedValue());
+	residency.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+	bindlessTable.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+}
+
+//waitQueueのブロックしない版。完了した分だけ解放する。
+void VulkanBase::pollQueue()
+{
+	for (auto& engine : queueEngines)
+	{
+		engine.poll();
+		jobDescriptors(engine).reclaim(engine.completedValue());
+		transientBuffers(engine).reclaim(engine.completedValue());
+	}
+	stagingRing.reclaim(transferEngine->completedValue());
+	residency.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+	bindlessTable.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+}
+
+//ファイルのSPIR-Vはマップして読み、作り終えたら手放す。ファイルが無ければVK_NULL_HANDLEを返す。
+VkShaderModule VulkanBase::createShaderModule(const char* fileName)
+{
+	SpirvBinary spirv;
+	if (!spirv.load(fileName, errors))
+	{
+		return VK_NULL_HANDLE;
+	}
+	VkShaderModule shaderModule = createShaderModule(spirv);
+	spirv.release();
+	return shaderModule;
+}
+
+VkShaderModule VulkanBase::createShaderModule(const SpirvBinary& spirv)
 {
-	//Xe[WOobt@j
+	return spirv.createShaderModule(device, errors);
+}
+
+//セットの数もデスクリプタの種類も決め打ちにせず、足りなくなればプールを足す
+void VulkanBase::createDescriptorPool()
+{
+	descriptorAllocator.create(device, 16u, errors);
+	//ジョブごとのセットはキューのタイムラインの値でまとめて返すので、キューごとに分ける
+	jobDescriptorAllocators.resize(queueEngines.size());
+	for (auto& jobDescriptorAllocator : jobDescriptorAllocators)
+	{
+		jobDescriptorAllocator.create(device, 16u, errors);
+	}
+}
+
+//add.compのbindingを手で書かず、リフレクションの結果からset 0のレイアウトを引く
+void VulkanBase::createDescriptorSetLayout()
+{
+	descriptorSetLayout = layoutCache.descriptorSetLayout(addInterface, 0u, errors);
+}
+
+DescriptorAllocator& VulkanBase::jobDescriptors(const SubmissionEngine& engine)
+{
+	return jobDescriptorAllocators[size_t(&engine - queueEngines.data())];
+}
+
+//binding 0に結び付けるバッファ。bindInputで取り込んだ配列があればそれを、無ければdeviceLocalBufferを指す。
+VkDescriptorBufferInfo VulkanBase::inputBinding() const
+{
+	VkDescriptorBufferInfo descriptorBufferInfo{};
+	descriptorBufferInfo.buffer = importedInput.buffer != VK_NULL_HANDLE ? importedInput.buffer : deviceLocalBuffer;
+	descriptorBufferInfo.offset = 0u;
+	descriptorBufferInfo.range = importedInput.buffer != VK_NULL_HANDLE ? importedInput.size : deviceLocalBufferSize;
+	return descriptorBufferInfo;
+}
+
+void VulkanBase::createComputeKernel()
+{
+	//add.compのconstant_id = 3 (value)には1.0を渡す
+	addKernel.maxGroupCountX = profile.limits().maxComputeWorkGroupCount[0];
+	const bool pushDescriptor = enablePushDescriptor && enabled.hasDeviceExtension("VK_KHR_push_descriptor");
+	addKernel.create(device, shaderModule, addInterface, layoutCache.pipelineLayout(addInterface, errors, pushDescriptor), 1.0f, pipelineCache, errors);
+	addKernel.createUpdateTemplate(addInterface, descriptorSetLayout, pushDescriptor, errors);
+}
+
+//bufferDeviceAddressが有効なら、同じadd.compをアドレスで受け取る版も作る。
+//レイアウトはセットを持たず、push_constantの範囲だけになる。
+void VulkanBase::createAddressKernel()
+{
+	if (enabled.features12.bufferDeviceAddress != VK_TRUE)
+	{
+		return;
+	}
+	SpirvBinary addressSpirv;
+	addressSpirv.assign(AddAddressCompSpirv);
+	addressShaderModule = createShaderModule(addressSpirv);
+	if (addressShaderModule == VK_NULL_HANDLE || !reflectSpirv(addressSpirv.words(), addressSpirv.wordCount(), addressInterface, errors))
+	{
+		return;
+	}
+	addressKernel.maxGroupCountX = profile.limits().maxComputeWorkGroupCount[0];
+	addressKernel.create(device, addressShaderModule, addressInterface, layoutCache.pipelineLayout(addressInterface, errors), 1.0f, pipelineCache, errors);
+	useDeviceAddress = true;
+}
+
+//descriptor indexingが揃っていれば、bindlessの配列を作ってdeviceLocalBufferを登録し、それを添字で引く版を作る。
+//パイプラインレイアウトはbindlessのセット1つとpush_constantの範囲になる。
+void VulkanBase::createBindlessKernel()
+{
+	const VkPhysicalDeviceVulkan12Features& features12 = enabled.features12;
+	if (!enableBindless || enabled.features.features.shaderStorageBufferArrayDynamicIndexing != VK_TRUE || features12.runtimeDescriptorArray != VK_TRUE ||
+		features12.descriptorBindingPartiallyBound != VK_TRUE || features12.descriptorBindingUpdateUnusedWhilePending != VK_TRUE || features12.descriptorBindingStorageBufferUpdateAfterBind != VK_TRUE)
+	{
+		return;
+	}
+	const VkPhysicalDeviceVulkan12Properties& properties12 = profile.properties12;
+	const uint32_t bufferLimit = properties12.maxDescriptorSetUpdateAfterBindStorageBuffers < properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers ?
+		properties12.maxDescriptorSetUpdateAfterBindStorageBuffers : properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+	const uint32_t imageLimit = properties12.maxDescriptorSetUpdateAfterBindStorageImages < properties12.maxPerStageDescriptorUpdateAfterBindStorageImages ?
+		properties12.maxDescriptorSetUpdateAfterBindStorageImages : properties12.maxPerStageDescriptorUpdateAfterBindStorageImages;
+	const uint32_t resourceLimit = properties12.maxPerStageUpdateAfterBindResources;
+	uint32_t bufferCapacity = bindlessBufferCapacity < bufferLimit ? bindlessBufferCapacity : bufferLimit;
+	uint32_t imageCapacity = bindlessImageCapacity < imageLimit ? bindlessImageCapacity : imageLimit;
+	//イメージの配列は対応していなければ持たない
+	if (features12.descriptorBindingStorageImageUpdateAfterBind != VK_TRUE || enabled.features.features.shaderStorageImageArrayDynamicIndexing != VK_TRUE)
+	{
+		imageCapacity = 0u;
+	}
+	//2つの配列は同じステージから見えるので、合計もステージあたりの上限に収める。削るのはイメージから。
+	bufferCapacity = bufferCapacity < resourceLimit ? bufferCapacity : resourceLimit;
+	imageCapacity = imageCapacity < resourceLimit - bufferCapacity ? imageCapacity : resourceLimit - bufferCapacity;
+	bindlessTable.create(device, bufferCapacity, imageCapacity, errors);
+	if (!bindlessTable.ready())
+	{
+		return;
+	}
+	deviceLocalBufferHandle = bindlessTable.registerBuffer(deviceLocalBuffer, 0u, deviceLocalBufferSize);
+
+	SpirvBinary bindlessSpirv;
+	bindlessSpirv.assign(AddBindlessCompSpirv);
+	bindlessShaderModule = createShaderModule(bindlessSpirv);
+	if (bindlessShaderModule == VK_NULL_HANDLE || !reflectSpirv(bindlessSpirv.words(), bindlessSpirv.wordCount(), bindlessInterface, errors))
+	{
+		return;
+	}
+	const vector<VkDescriptorSetLayout> setLayouts = { bindlessTable.descriptorSetLayout() };
+	bindlessKernel.maxGroupCountX = profile.limits().maxComputeWorkGroupCount[0];
+	bindlessKernel.create(device, bindlessShaderModule, bindlessInterface, layoutCache.pipelineLayout(setLayouts, bindlessInterface.stage, bindlessInterface.pushConstantSize, errors), 1.0f, pipelineCache, errors);
+	useBindless = true;
+}
+
+//小さな配列はアリーナのブロックから切り出し、ダイナミックオフセットでadd.compのbinding 0に結び付ける。
+//オフセットはminStorageBufferOffsetAlignmentに揃え、ダイナミックオフセットは32ビットなのでブロックはそれに収まる大きさにする。
+void VulkanBase::createBufferArena()
+{
+	const VkPhysicalDeviceLimits& limits = profile.limits();
+	const VkDeviceSize alignment = limits.minStorageBufferOffsetAlignment > 4u ? limits.minStorageBufferOffsetAlignment : 4u;
+	const VkDeviceSize rangeLimit = arenaRangeLimit < VkDeviceSize(limits.maxStorageBufferRange) ? arenaRangeLimit : VkDeviceSize(limits.maxStorageBufferRange);
+	const VkDeviceSize blockSize = arenaBlockSize < VkDeviceSize(UINT32_MAX) - rangeLimit ? arenaBlockSize : VkDeviceSize(UINT32_MAX) - rangeLimit;
+	bufferArena.create(allocator, persistentPool, blockSize, rangeLimit, alignment, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage(), sharedQueueFamilyIndices(), errors);
+	arenaBindlessRange = blockSize + rangeLimit <= VkDeviceSize(limits.maxStorageBufferRange) ? blockSize + rangeLimit : 0u;
+
+	arenaInterface = addInterface;
+	for (auto& binding : arenaInterface.bindings)
+	{
+		if (binding.set == 0u && binding.binding == 0u && binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		{
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		}
+	}
+	arenaSetLayout = layoutCache.descriptorSetLayout(arenaInterface, 0u, errors);
+	arenaKernel.maxGroupCountX = profile.limits().maxComputeWorkGroupCount[0];
+	arenaKernel.create(device, shaderModule, arenaInterface, layoutCache.pipelineLayout(arenaInterface, errors), 1.0f, pipelineCache, errors);
+
+	//プールを作れなければアリーナと預かったバッファは既定のプールにあるので、そちらを詰める。
+	//VMAはパスの上限より大きな確保を動かさないので、上限はアリーナのブロックが収まる大きさにする。
+	const VkDeviceSize bytesPerPass = defragmentBytesPerPass > bufferArena.blockBufferSize() ? defragmentBytesPerPass : bufferArena.blockBufferSize();
+	defragmenter.create(allocator, persistentPool, bytesPerPass, defragmentAllocationsPerPass);
+}
+
+//ブロックのセットは最初に使う時に書き、以後はダイナミックオフセットだけを変えて使い回す
+VkDescriptorSet VulkanBase::arenaDescriptorSet(uint32_t block)
+{
+	while (arenaDescriptorSets.size() <= block)
+	{
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		if (!descriptorAllocator.allocate(arenaSetLayout, descriptorSet))
+		{
+			return VK_NULL_HANDLE;
+		}
+		writeArenaDescriptorSet(descriptorSet, uint32_t(arenaDescriptorSets.size()));
+		arenaDescriptorSets.push_back(descriptorSet);
+	}
+	return arenaDescriptorSets[block];
+}
+
+//ブロックのバッファをセットに書く。デフラグでバッファが替わった時も、セットを使うサブミットが無い間に書き直す。
+void VulkanBase::writeArenaDescriptorSet(VkDescriptorSet descriptorSet, uint32_t block)
+{
+	VkDescriptorBufferInfo descriptorBufferInfo{};
+	descriptorBufferInfo.buffer = bufferArena.blockBuffer(block);
+	descriptorBufferInfo.offset = 0u;
+	descriptorBufferInfo.range = bufferArena.rangeLimit();
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.pNext = nullptr;
+	writeDescriptorSet.dstSet = descriptorSet;
+	writeDescriptorSet.dstBinding = 0u;
+	writeDescriptorSet.dstArrayElement = 0u;
+	writeDescriptorSet.descriptorCount = 1u;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	writeDescriptorSet.pImageInfo = nullptr;
+	writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+	writeDescriptorSet.pTexelBufferView = nullptr;
+	vkUpdateDescriptorSets(device, 1u, &writeDescriptorSet, 0u, nullptr);
+}
+
+//ブロックを読み書きするサブミットのチケットを、キューごとに最後のものだけ残す。値はキューごとに増えるので、それが終われば前のものも終わっている。
+uint64_t VulkanBase::touchArena(uint32_t block, uint64_t ticket)
+{
+	if (ticket == 0u)
+	{
+		return 0u;
+	}
+	const size_t index = size_t(block) * queueEngines.size() + size_t(ticket >> TicketQueueShift);
+	if (arenaTickets.size() <= index)
+	{
+		arenaTickets.resize(index + 1u, 0u);
+	}
+	arenaTickets[index] = ticket > arenaTickets[index] ? ticket : arenaTickets[index];
+	return ticket;
+}
+
+//ブロックを読み書きしていて、まだ完了していないサブミットのチケット。キューごとに1つまで。
+vector<uint64_t> VulkanBase::arenaPending(uint32_t block)
+{
+	vector<uint64_t> tickets;
+	for (size_t i = 0; i < queueEngines.size(); i++)
+	{
+		const size_t index = size_t(block) * queueEngines.size() + i;
+		if (index < arenaTickets.size() && arenaTickets[index] != 0u && !ticketCompleted(arenaTickets[index]))
+		{
+			tickets.push_back(arenaTickets[index]);
+		}
+	}
+	return tickets;
+}
+
+//ブロックは最初に使う時に登録し、以後は配列の位置を要素のオフセットで渡す。登録できなければBindlessInvalidHandleを返す。
+uint32_t VulkanBase::arenaBindlessHandle(uint32_t block)
+{
+	if (!useBindless || arenaBindlessRange == 0u)
+	{
+		return BindlessInvalidHandle;
+	}
+	while (arenaBindlessHandles.size() <= block)
+	{
+		arenaBindlessHandles.push_back(bindlessTable.registerBuffer(bufferArena.blockBuffer(uint32_t(arenaBindlessHandles.size())), 0u, arenaBindlessRange));
+	}
+	return arenaBindlessHandles[block];
+}
+
+//追い出しや戻しで登録を外されていれば、今のバッファを登録し直す。デフラグでは同じ添字を書き直す。
+uint32_t VulkanBase::residentBindlessHandle(const ResidentBuffer& buffer)
+{
+	if (!useBindless)
+	{
+		return BindlessInvalidHandle;
+	}
+	if (residentBindings.size() <= buffer.handle)
+	{
+		residentBindings.resize(buffer.handle + 1u, { BindlessInvalidHandle, 0u });
+	}
+	ResidentBinding& binding = residentBindings[buffer.handle];
+	if (binding.handle == BindlessInvalidHandle)
+	{
+		binding.handle = bindlessTable.registerBuffer(residency.buffer(buffer.handle), 0u, buffer.size);
+		binding.size = buffer.size;
+	}
+	return binding.handle;
+}
+
+VkDeviceAddress VulkanBase::bufferAddress(VkBuffer buffer) const
+{
+	VkBufferDeviceAddressInfo bufferDeviceAddressInfo{};
+	bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	bufferDeviceAddressInfo.pNext = nullptr;
+	bufferDeviceAddressInfo.buffer = buffer;
+	return vkGetBufferDeviceAddress(device, &bufferDeviceAddressInfo);
+}
+
+//カーネルが読み書きするバッファの用途。デバイスアドレスを使う時はアドレスを取れるようにする。
+VkBufferUsageFlags VulkanBase::storageBufferUsage() const
+{
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	if (enabled.features12.bufferDeviceAddress == VK_TRUE)
+	{
+		usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	return usage;
+}
+
+//ジョブのバッファをbinding 0から順に結び付ける。push descriptorが使えればコマンドバッファへ直接積んでVK_NULL_HANDLEを返し、
+//使えなければengineのセットを1つ切り出してテンプレートで書く。そのセットはサブミット後にjobDescriptorsでretireすること。
+//セットのレイアウトはadd.compのset 0を使う。
+VkDescriptorSet VulkanBase::bindKernel(SubmissionEngine& engine, VkCommandBuffer commandBuffer, ComputeKernel& kernel, const VkDescriptorBufferInfo* bufferInfos)
+{
+	if (kernel.pushDescriptor())
+	{
+		kernel.push(commandBuffer, bufferInfos);
+		return VK_NULL_HANDLE;
+	}
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	if (jobDescriptors(engine).allocate(descriptorSetLayout, descriptorSet))
+	{
+		kernel.write(descriptorSet, bufferInfos);
+	}
+	return descriptorSet;
+}
+
+void VulkanBase::dispatchKernel(VkCommandBuffer commandBuffer, ComputeKernel& kernel, VkDescriptorSet descriptorSet, uint32_t elementCount, uint32_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+{
+	//先に積まれたカーネルの書き込みを読み書きするので、その完了を待つ
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = nullptr;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0u, 1u, &memoryBarrier, 0u, nullptr, 0u, nullptr);
+	kernel.dispatch(commandBuffer, descriptorSet, elementCount, dynamicOffsetCount, dynamicOffsets);
+	if (importedInput.buffer != VK_NULL_HANDLE)
+	{
+		//取り込んだ配列にはカーネルが直接書くので、完了後にホストから読めるようにしておく
+		VkBufferMemoryBarrier bufferMemoryBarrier{};
+		bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferMemoryBarrier.pNext = nullptr;
+		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.buffer = importedInput.buffer;
+		bufferMemoryBarrier.offset = 0u;
+		bufferMemoryBarrier.size = importedInput.size;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+	}
+}
+
+//deviceLocalBufferの先頭elementCount個のfloatにカーネルを適用するサブミットを積み、チケットを返す。完了は待たない。
+//afterに別のチケットを渡すと、そのサブミットの完了を待ってから実行する。
+//priorityがInteractiveなら優先度の高いキューへ、Bulkなら空いている計算キューへ送る。
+uint64_t VulkanBase::compute(uint32_t elementCount, uint64_t after, JobPriority priority)
+{
+	SubmissionEngine& engine = scheduler.select(priority);
+	VkCommandBuffer commandBuffer = engine.begin();
+	vector<TimelineWait> waits = acquireDeviceLocalBuffer(commandBuffer, engine);
+	const VkDescriptorBufferInfo binding = inputBinding();
+	if (useDeviceAddress)
+	{
+		//デスクリプタを使わず、アドレスと要素数をコマンドバッファに積む
+		AddressParameters parameters{};
+		parameters.outputData = bufferAddress(binding.buffer);
+		parameters.elementCount = elementCount;
+		addressKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, addressKernel, VK_NULL_HANDLE, elementCount);
+	}
+	else if (useBindless)
+	{
+		//登録済みの配列のセットを結び付け、添字だけを積む
+		BindlessParameters parameters{};
+		parameters.bufferIndex = importedInput.buffer != VK_NULL_HANDLE ? importedInputHandle : deviceLocalBufferHandle;
+		parameters.elementCount = elementCount;
+		bindlessKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, bindlessKernel, bindlessTable.descriptorSet(), elementCount);
+	}
+	else
+	{
+		AddParameters parameters{};
+		parameters.elementCount = elementCount;
+		addKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, addKernel, bindKernel(engine, commandBuffer, addKernel, &binding), elementCount);
+	}
+	if (after != 0u)
+	{
+		waits.push_back(dependency(after, engine, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+	}
+	const uint64_t value = flowQueue(engine, commandBuffer, waits);
+	if (value != 0u)
+	{
+		jobDescriptors(engine).retire(value);
+	}
+	return makeTicket(engine, value);
+}
+
+//溜まっているサブミットを待ち時間を待たずに送る
+void VulkanBase::flush()
+{
+	for (auto& engine : queueEngines)
+	{
+		engine.flush();
+	}
+}
+
+bool VulkanBase::isComplete(uint64_t ticket)
+{
+	pollQueue();
+	return ticketEngine(ticket).isComplete(ticket & TicketValueMask);
+}
+
+void VulkanBase::wait(uint64_t ticket)
+{
+	SubmissionEngine& engine = ticketEngine(ticket);
+	engine.wait(ticket & TicketValueMask);
+	jobDescriptors(engine).reclaim(engine.completedValue());
+	transientBuffers(engine).reclaim(engine.completedValue());
+	stagingRing.reclaim(transferEngine->completedValue());
+	residency.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+	bindlessTable.collect([this](uint64_t ticket) { return ticketCompleted(ticket); });
+}
+
+//dataをdeviceLocalBufferのdstOffsetへ転送し、チケットを返す。完了は待たない。
+//ゼロコピーならマップしたメモリへ直接書き、その場で完了するので0を返す。そうでなければステージングリングを通す。
+uint64_t VulkanBase::upload(const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+	if (dstOffset + size > deviceLocalBufferSize)
+	{
+		errors.push_back("upload range exceeds deviceLocalBuffer in upload");
+		return 0u;
+	}
+	if (deviceLocalBufferMapped != nullptr)
+	{
+		uploadDirect(data, size, dstOffset);
+		return 0u;
+	}
+	return uploadStaged(data, size, deviceLocalBuffer, dstOffset);
+}
+
+//deviceLocalBufferへ書く時だけ転送キューへ持ち主を移す。アリーナのバッファはどのキューからも使える。
+//aftersのチケットの完了を待ってから書き込む。
+uint64_t VulkanBase::uploadStaged(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, const vector<uint64_t>& afters)
+{
+	const VkDeviceSize alignment = profile.limits().optimalBufferCopyOffsetAlignment > 4u ? profile.limits().optimalBufferCopyOffsetAlignment : 4u;
+	StagingAllocation staging{};
+	if (!stagingRing.allocate(size, alignment, staging))
+	{
+		//空きが無ければ実行中のサブミットの完了を待って解放してから取り直す
+		waitQueue();
+		if (!stagingRing.allocate(size, alignment, staging))
+		{
+			errors.push_back("upload size exceeds staging ring in uploadStaged");
+			return 0u;
+		}
+	}
+	memcpy(staging.data, data, size_t(size));
+	stagingRing.flush(staging);
+	VkCommandBuffer commandBuffer = transferEngine->begin();
+	vector<TimelineWait> waits = dstBuffer == deviceLocalBuffer ? acquireDeviceLocalBuffer(commandBuffer, *transferEngine) : vector<TimelineWait>();
+	copyBuffer(commandBuffer, staging.buffer, staging.offset, dstBuffer, dstOffset, size);
+	for (const auto after : afters)
+	{
+		if (after != 0u)
+		{
+			waits.push_back(dependency(after, *transferEngine, VK_PIPELINE_STAGE_TRANSFER_BIT));
+		}
+	}
+	const uint64_t value = flowQueue(*transferEngine, commandBuffer, waits);
+	if (value != 0u)
+	{
+		//このサブミットが読むステージング領域は、転送キューのタイムラインがvalueに達するまで再利用しない
+		stagingRing.retire(value);
+	}
+	return makeTicket(*transferEngine, value);
+}
+
+//コピーもバリアも要らない。サブミット前のホストの書き込みはvkQueueSubmitで暗黙にGPUから見えるようになる。
+void VulkanBase::uploadDirect(const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+	//実行中のカーネルが読み書きしている領域を上書きしないよう、先に完了を待つ
+	waitQueue();
+	memcpy(static_cast<uint8_t*>(deviceLocalBufferMapped) + dstOffset, data, size_t(size));
+	vmaFlushAllocation(allocator, deviceLocalBufferAllocation, dstOffset, size);
+}
+
+//dataをadd.compのbinding 0に結び付ける。取り込めればホストの配列をそのまま使い、カーネルの結果もdataに直接書かれる。
+//dataとsizeがHostImporter::alignment()に揃っていない、または拡張が無い場合は
+//ステージングリング経由でdeviceLocalBufferへ転送してfalseを返す。結果はdownloadで読む。
+bool VulkanBase::bindInput(void* data, VkDeviceSize size)
+{
+	unbindInput();
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage();
+	//ジョブは積む時にバッファを結び付けるので、実行中のジョブを待たずに差し替えられる
+	if (hostImporter.import(data, size, usage, importedInput, errors))
+	{
+		if (useBindless)
+		{
+			importedInputHandle = bindlessTable.registerBuffer(importedInput.buffer, 0u, importedInput.size);
+		}
+		return true;
+	}
+	upload(data, size);
+	return false;
+}
+
+//取り込んだ配列を手放し、binding 0をdeviceLocalBufferに戻す
+void VulkanBase::unbindInput()
+{
+	if (importedInput.buffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	//配列を結び付けたジョブが終わるまでは手放せない
+	waitQueue();
+	if (importedInputHandle != BindlessInvalidHandle)
+	{
+		bindlessTable.unregisterBuffer(importedInputHandle);
+		importedInputHandle = BindlessInvalidHandle;
+	}
+	hostImporter.release(importedInput);
+}
+
+//登録したバッファはどのカーネルからもbindlessTableのセットの添字で引ける
+uint32_t VulkanBase::registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	if (!useBindless)
+	{
+		return BindlessInvalidHandle;
+	}
+	return bindlessTable.registerBuffer(buffer, offset, range);
+}
+
+//afterを渡せば、完了はwaitやpollQueueで確かめてから外す
+void VulkanBase::unregisterBuffer(uint32_t handle, uint64_t after)
+{
+	if (!useBindless)
+	{
+		return;
+	}
+	bindlessTable.retireBuffer(handle, after);
+}
+
+//カーネルは要素数で範囲外を捨てるので、配列はsizeのまま切り出す
+bool VulkanBase::allocateArray(VkDeviceSize size, ArenaRange& range)
+{
+	return bufferArena.allocate(size, range);
+}
+
+void VulkanBase::freeArray(ArenaRange& range)
+{
+	bufferArena.free(range);
+}
+
+VkDescriptorBufferInfo VulkanBase::arrayBinding(const ArenaRange& range) const
+{
+	VkDescriptorBufferInfo binding{};
+	if (bufferArena.valid(range))
+	{
+		binding.buffer = bufferArena.blockBuffer(range.block);
+		binding.offset = range.offset;
+		binding.range = range.range;
+	}
+	return binding;
+}
+
+//アリーナのバッファはホストから見えないので、常にステージングリングを通す。
+//別のキューのジョブがまだ読んでいるうちに書き換えないよう、ブロックを使っている未完了のサブミットとafterの完了を待つ。
+uint64_t VulkanBase::upload(const void* data, VkDeviceSize size, const ArenaRange& range, uint64_t after)
+{
+	if (!bufferArena.valid(range) || size > range.range)
+	{
+		errors.push_back("upload range exceeds arena range in upload");
+		return 0u;
+	}
+	vector<uint64_t> afters = arenaPending(range.block);
+	afters.push_back(after);
+	return touchArena(range.block, uploadStaged(data, size, bufferArena.blockBuffer(range.block), range.offset, afters));
+}
+
+//rangeの先頭elementCount個のfloatにカーネルを適用する。ブロックのセットを結び付け、配列のオフセットはダイナミックオフセットで渡す。
+//アリーナのバッファは持ち主を移さないので、転送との順序はafterのチケットだけで決まる。
+uint64_t VulkanBase::compute(const ArenaRange& range, uint32_t elementCount, uint64_t after, JobPriority priority)
+{
+	if (!bufferArena.valid(range) || VkDeviceSize(elementCount) * sizeof(float) > range.range)
+	{
+		errors.push_back("element count exceeds arena range in compute");
+		return 0u;
+	}
+	const uint32_t bindlessHandle = useDeviceAddress ? BindlessInvalidHandle : arenaBindlessHandle(range.block);
+	const bool useSet = !useDeviceAddress && bindlessHandle == BindlessInvalidHandle;
+	const VkDescriptorSet descriptorSet = useSet ? arenaDescriptorSet(range.block) : VK_NULL_HANDLE;
+	if (useSet && descriptorSet == VK_NULL_HANDLE)
+	{
+		return 0u;
+	}
+	SubmissionEngine& engine = scheduler.select(priority);
+	VkCommandBuffer commandBuffer = engine.begin();
+	if (useDeviceAddress)
+	{
+		//デフラグでブロックのバッファが差し替わるので、今のバッファのアドレスに範囲の位置を足す
+		AddressParameters parameters{};
+		parameters.outputData = bufferAddress(bufferArena.blockBuffer(range.block)) + range.offset;
+		parameters.elementCount = elementCount;
+		addressKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, addressKernel, VK_NULL_HANDLE, elementCount);
+	}
+	else if (bindlessHandle != BindlessInvalidHandle)
+	{
+		//オフセットはminStorageBufferOffsetAlignmentに揃っているので、floatの数で割り切れる
+		BindlessParameters parameters{};
+		parameters.bufferIndex = bindlessHandle;
+		parameters.elementCount = elementCount;
+		parameters.elementOffset = uint32_t(range.offset / sizeof(float));
+		bindlessKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, bindlessKernel, bindlessTable.descriptorSet(), elementCount);
+	}
+	else
+	{
+		const uint32_t dynamicOffset = uint32_t(range.offset);
+		AddParameters parameters{};
+		parameters.elementCount = elementCount;
+		arenaKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, arenaKernel, descriptorSet, elementCount, 1u, &dynamicOffset);
+	}
+	vector<TimelineWait> waits;
+	if (after != 0u)
+	{
+		waits.push_back(dependency(after, engine, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+	}
+	return touchArena(range.block, makeTicket(engine, flowQueue(engine, commandBuffer, waits)));
+}
+
+bool VulkanBase::createResidentBuffer(VkDeviceSize size, ResidentBuffer& buffer)
+{
+	evictColdBuffers(ResidentInvalidHandle, size);
+	return residency.add(size, buffer);
+}
+
+//最後に使ったサブミットが終わってから実体とbindlessの登録を破棄する
+void VulkanBase::destroyResidentBuffer(ResidentBuffer& buffer)
+{
+	if (buffer.handle < uint32_t(residentBindings.size()) && residentBindings[buffer.handle].handle != BindlessInvalidHandle)
+	{
+		bindlessTable.retireBuffer(residentBindings[buffer.handle].handle, residency.ticket(buffer.handle));
+		residentBindings[buffer.handle] = { BindlessInvalidHandle, 0u };
+	}
+	residency.remove(buffer);
+}
+
+//追い出されていればホスト側の実体へ書く。戻す時にそのままデバイスへ運ばれる。
+uint64_t VulkanBase::upload(const void* data, VkDeviceSize size, const ResidentBuffer& buffer)
+{
+	if (buffer.handle == ResidentInvalidHandle || size > buffer.size)
+	{
+		errors.push_back("upload range exceeds resident buffer in upload");
+		return 0u;
+	}
+	const uint64_t ticket = uploadStaged(data, size, residency.buffer(buffer.handle), 0u, { residency.ticket(buffer.handle) });
+	residency.touch(buffer.handle, ticket);
+	return ticket;
+}
+
+//追い出されていれば、他のバッファを追い出して場所を空けてから戻す。戻しのコピーはバッファのチケットとして待たれる。
+uint64_t VulkanBase::compute(const ResidentBuffer& buffer, uint32_t elementCount, uint64_t after, JobPriority priority)
+{
+	if (buffer.handle == ResidentInvalidHandle || VkDeviceSize(elementCount) * sizeof(float) > buffer.size)
+	{
+		errors.push_back("element count exceeds resident buffer in compute");
+		return 0u;
+	}
+	if (!residency.resident(buffer.handle))
+	{
+		evictColdBuffers(buffer.handle, buffer.size);
+		ResidencyMove move{};
+		if (!residency.beginRestore(buffer.handle, move))
+		{
+			return 0u;
+		}
+		moveResident(move);
+	}
+	const uint32_t bindlessHandle = useDeviceAddress ? BindlessInvalidHandle : residentBindlessHandle(buffer);
+	SubmissionEngine& engine = scheduler.select(priority);
+	VkCommandBuffer commandBuffer = engine.begin();
+	VkDescriptorBufferInfo binding{};
+	binding.buffer = residency.buffer(buffer.handle);
+	binding.offset = 0u;
+	binding.range = buffer.size;
+	if (useDeviceAddress)
+	{
+		//追い出しや戻しでバッファが変わるので、アドレスはディスパッチのたびに引く
+		AddressParameters parameters{};
+		parameters.outputData = bufferAddress(binding.buffer);
+		parameters.elementCount = elementCount;
+		addressKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, addressKernel, VK_NULL_HANDLE, elementCount);
+	}
+	else if (bindlessHandle != BindlessInvalidHandle)
+	{
+		BindlessParameters parameters{};
+		parameters.bufferIndex = bindlessHandle;
+		parameters.elementCount = elementCount;
+		bindlessKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, bindlessKernel, bindlessTable.descriptorSet(), elementCount);
+	}
+	else
+	{
+		AddParameters parameters{};
+		parameters.elementCount = elementCount;
+		addKernel.pushConstants(commandBuffer, &parameters);
+		dispatchKernel(commandBuffer, addKernel, bindKernel(engine, commandBuffer, addKernel, &binding), elementCount);
+	}
+	vector<TimelineWait> waits;
+	for (const auto ticket : { after, residency.ticket(buffer.handle) })
+	{
+		if (ticket != 0u)
+		{
+			waits.push_back(dependency(ticket, engine, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+		}
+	}
+	const uint64_t value = flowQueue(engine, commandBuffer, waits);
+	if (value != 0u)
+	{
+		jobDescriptors(engine).retire(value);
+	}
+	const uint64_t ticket = makeTicket(engine, value);
+	residency.touch(buffer.handle, ticket);
+	return ticket;
+}
+
+//ヒープごとの使用量と予算、追い出したバッファの量を出力する
+void VulkanBase::residencyLog()
+{
+	residency.updateBudgets();
+	char line[256];
+	debugOutput("=====Residency=====\n");
+	for (uint32_t i = 0; i < residency.heapCount(); i++)
+	{
+		const VmaBudget& budget = residency.heapBudget(i);
+		snprintf(line, sizeof(line), "heap %u%s: %llu / %llu bytes, %u blocks\n", i, (profile.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+			(unsigned long long)budget.usage, (unsigned long long)budget.budget, budget.statistics.blockCount);
+		debugOutput(line);
+	}
+	snprintf(line, sizeof(line), "resident %llu bytes, evicted %llu bytes, %llu evictions, %llu restores\n",
+		(unsigned long long)residency.residentBytes(), (unsigned long long)residency.evictedBytes(), (unsigned long long)residency.evictionCount(), (unsigned long long)residency.restoreCount());
+	debugOutput(line);
+	const VmaDefragmentationStats& defragmentationStats = defragmenter.stats();
+	snprintf(line, sizeof(line), "defragment: %llu passes, %llu bytes in %u moves, %llu bytes in %u blocks freed\n",
+		(unsigned long long)defragmenter.passCount(), (unsigned long long)defragmentationStats.bytesMoved, defragmentationStats.allocationsMoved,
+		(unsigned long long)defragmentationStats.bytesFreed, defragmentationStats.deviceMemoryBlocksFreed);
+	debugOutput(line);
+	debugOutput("===================\n");
+}
+
+//アリーナのブロックならどれかのキューが、預かったバッファなら最後に使ったサブミットがまだ終わっていなければtrueを返す
+bool VulkanBase::allocationBusy(VmaAllocation allocation)
+{
+	uint32_t block = 0u;
+	if (bufferArena.findBlock(allocation, block))
+	{
+		return !arenaPending(block).empty();
+	}
+	const uint32_t handle = residency.findHandle(allocation);
+	return handle != ResidentInvalidHandle && residency.ticket(handle) != 0u && !ticketCompleted(residency.ticket(handle));
+}
+
+//移される確保の持ち主を探し、移し先のメモリに同じ作りのバッファを作る
+bool VulkanBase::createMovedBuffer(const VmaDefragmentationMove& move, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size)
+{
+	return bufferArena.createMovedBuffer(move.srcAllocation, move.dstTmpAllocation, srcBuffer, dstBuffer, size)
+		|| residency.createMovedBuffer(move.srcAllocation, move.dstTmpAllocation, srcBuffer, dstBuffer, size);
+}
+
+//パスごとに、移し先のバッファを作って転送キューでまとめてコピーし、完了を待ってから持ち主のバッファとアリーナのセットを差し替える。
+//持ち主の分からない確保や作り直せなかった確保、まだ使われている確保はVMAに動かさないよう伝える。
+//デバイスアドレスはカーネルを積むたびにbufferAddressで引き直すので、差し替えたバッファがそのまま使われる。
+bool VulkanBase::defragment(uint32_t maxMicroseconds)
+{
+	const auto start = chrono::steady_clock::now();
+	VmaDefragmentationPassMoveInfo passInfo{};
+	vector<VkBuffer> srcBuffers;
+	vector<VkBuffer> dstBuffers;
+	//パスはコピーの完了を待つので、時間を使い切っていれば次のパスに入らない
+	while (chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() < maxMicroseconds)
+	{
+		if (!defragmenter.beginPass(passInfo))
+		{
+			return true;
+		}
+		//完了したサブミットを確かめ、まだ読み書きされている確保はキューを待たずに今回は動かさない
+		pollQueue();
+		srcBuffers.assign(passInfo.moveCount, VK_NULL_HANDLE);
+		dstBuffers.assign(passInfo.moveCount, VK_NULL_HANDLE);
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		for (uint32_t i = 0; i < passInfo.moveCount; i++)
+		{
+			VmaDefragmentationMove& move = passInfo.pMoves[i];
+			VkDeviceSize size = 0u;
+			if (allocationBusy(move.srcAllocation) || !createMovedBuffer(move, srcBuffers[i], dstBuffers[i], size))
+			{
+				move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+				continue;
+			}
+			if (commandBuffer == VK_NULL_HANDLE)
+			{
+				commandBuffer = transferEngine->begin();
+			}
+			copyBuffer(commandBuffer, srcBuffers[i], 0u, dstBuffers[i], 0u, size);
+		}
+		const uint64_t ticket = commandBuffer != VK_NULL_HANDLE ? makeTicket(*transferEngine, flowQueue(*transferEngine, commandBuffer)) : 0u;
+		if (ticket != 0u)
+		{
+			wait(ticket);
+		}
+		for (uint32_t i = 0; i < passInfo.moveCount; i++)
+		{
+			if (dstBuffers[i] == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+			VmaAllocation allocation = passInfo.pMoves[i].srcAllocation;
+			uint32_t block = 0u;
+			VkBuffer oldBuffer = bufferArena.replaceBuffer(allocation, dstBuffers[i], block);
+			if (oldBuffer != VK_NULL_HANDLE)
+			{
+				if (block < uint32_t(arenaDescriptorSets.size()))
+				{
+					writeArenaDescriptorSet(arenaDescriptorSets[block], block);
+				}
+				if (block < uint32_t(arenaBindlessHandles.size()) && arenaBindlessHandles[block] != BindlessInvalidHandle)
+				{
+					bindlessTable.updateBuffer(arenaBindlessHandles[block], dstBuffers[i], 0u, arenaBindlessRange);
+				}
+			}
+			else
+			{
+				oldBuffer = residency.replaceBuffer(allocation, dstBuffers[i]);
+				const uint32_t handle = residency.findHandle(allocation);
+				if (handle < uint32_t(residentBindings.size()) && residentBindings[handle].handle != BindlessInvalidHandle)
+				{
+					bindlessTable.updateBuffer(residentBindings[handle].handle, dstBuffers[i], 0u, residentBindings[handle].size);
+				}
+			}
+			//メモリはVMAがパスの終わりに解放するので、バッファだけを破棄する
+			vkDestroyBuffer(device, oldBuffer, nullptr);
+		}
+		if (defragmenter.endPass(passInfo))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//ステージング経由とゼロコピーでsizeバイトの転送をiterations回ずつ行い、帯域を出力する。
+//ゼロコピーはデバイスが対応している時だけ計る。
+void VulkanBase::benchmarkUpload(VkDeviceSize size, uint32_t iterations)
+{
+	if (size > deviceLocalBufferSize)
+	{
+		size = deviceLocalBufferSize;
+	}
+	vector<uint8_t> data(size_t(size), 0u);
+	char line[256];
+	debugOutput("=====Upload=====\n");
+
+	auto start = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		if (uploadStaged(data.data(), size, deviceLocalBuffer, 0u) == 0u)
+		{
+			return;
+		}
+		waitQueue();
+	}
+	double milliseconds = elapsedMilliseconds(start);
+	snprintf(line, sizeof(line), "staging: %.3f ms, %.3f GB/s\n", milliseconds / iterations, double(size) * iterations / (milliseconds * 1.0e6));
+	debugOutput(line);
+
+	if (deviceLocalBufferMapped != nullptr)
+	{
+		start = chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			uploadDirect(data.data(), size, 0u);
+		}
+		milliseconds = elapsedMilliseconds(start);
+		snprintf(line, sizeof(line), "zero-copy: %.3f ms, %.3f GB/s\n", milliseconds / iterations, double(size) * iterations / (milliseconds * 1.0e6));
+		debugOutput(line);
+	}
+	else
+	{
+		debugOutput("zero-copy: not available on this device\n");
+	}
+	debugOutput("================\n");
+}
+
+//テンプレートを使わずにVkWriteDescriptorSetでbinding 0を書く。benchmarkDispatchで比べるためのもの。
+static void writeStorageBuffer(VkDevice device, VkDescriptorSet descriptorSet, const VkDescriptorBufferInfo& descriptorBufferInfo)
+{
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.pNext = nullptr;
+	writeDescriptorSet.dstSet = descriptorSet; //このデスクリプタセットの
+	writeDescriptorSet.dstBinding = 0u; //binding=0の
+	writeDescriptorSet.dstArrayElement = 0u; //0番目の
+	writeDescriptorSet.descriptorCount = 1u; //1個の
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; //ストレージバッファのデスクリプタを
+	writeDescriptorSet.pImageInfo = nullptr;
+	writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+	writeDescriptorSet.pTexelBufferView = nullptr;
+	vkUpdateDescriptorSets(device, 1u, &writeDescriptorSet, 0u, nullptr);
+}
+
+//ジョブごとにバッファを結び付けてディスパッチを積む記録のコストを、セットの確保とvkUpdateDescriptorSets、
+//セットの確保と更新テンプレート、push descriptor、push_constantのデバイスアドレス、bindlessの配列の添字の5通りで
+//jobCount回ずつ計り、1ジョブあたりの時間を出力する。後ろの3つはデバイスが対応していて有効にした時だけ計る。
+void VulkanBase::benchmarkDispatch(uint32_t jobCount)
+{
+	if (jobCount == 0u)
+	{
+		return;
+	}
+	const bool pushSupported = enabled.hasDeviceExtension("VK_KHR_push_descriptor");
+	//addKernelの方式に関係なく比べられるよう、両方のカーネルを作る
+	ComputeKernel setKernel;
+	setKernel.maxGroupCountX = addKernel.maxGroupCountX;
+	setKernel.create(device, shaderModule, addInterface, layoutCache.pipelineLayout(addInterface, errors), 1.0f, pipelineCache, errors);
+	setKernel.createUpdateTemplate(addInterface, descriptorSetLayout, false, errors);
+	ComputeKernel pushKernel;
+	if (pushSupported)
+	{
+		pushKernel.maxGroupCountX = addKernel.maxGroupCountX;
+		pushKernel.create(device, shaderModule, addInterface, layoutCache.pipelineLayout(addInterface, errors, true), 1.0f, pipelineCache, errors);
+		pushKernel.createUpdateTemplate(addInterface, descriptorSetLayout, true, errors);
+	}
+	//記録のコストだけを比べたいので、1ジョブは1グループ分にする
+	const uint32_t elementCount = addKernel.groupInvocationCount();
+	const VkDescriptorBufferInfo binding = inputBinding();
+	AddParameters addParameters{};
+	addParameters.elementCount = elementCount;
+	AddressParameters parameters{};
+	parameters.outputData = useDeviceAddress ? bufferAddress(binding.buffer) : 0u;
+	parameters.elementCount = elementCount;
+	BindlessParameters bindlessParameters{};
+	bindlessParameters.bufferIndex = importedInput.buffer != VK_NULL_HANDLE ? importedInputHandle : deviceLocalBufferHandle;
+	bindlessParameters.elementCount = elementCount;
+	const char* pathNames[] = { "vkUpdateDescriptorSets", "update template", "push descriptor", "device address", "bindless" };
+	char line[256];
+	debugOutput("=====Dispatch=====\n");
+	for (uint32_t path = 0; path < 5u; path++)
+	{
+		if ((path == 2u && !pushSupported) || (path == 3u && !useDeviceAddress) || (path == 4u && !useBindless))
+		{
+			snprintf(line, sizeof(line), "%s: not available on this device\n", pathNames[path]);
+			debugOutput(line);
+			continue;
+		}
+		ComputeKernel& kernel = path == 4u ? bindlessKernel : path == 3u ? addressKernel : path == 2u ? pushKernel : setKernel;
+		SubmissionEngine& engine = scheduler.select(JobPriority::Bulk);
+		DescriptorAllocator& descriptors = jobDescriptors(engine);
+		VkCommandBuffer commandBuffer = engine.begin();
+		vector<TimelineWait> waits = acquireDeviceLocalBuffer(commandBuffer, engine);
+
+		uint32_t jobs = 0u;
+		const auto start = chrono::steady_clock::now();
+		for (; jobs < jobCount; jobs++)
+		{
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			if (path == 4u)
+			{
+				descriptorSet = bindlessTable.descriptorSet();
+				kernel.pushConstants(commandBuffer, &bindlessParameters);
+			}
+			else if (path == 3u)
+			{
+				kernel.pushConstants(commandBuffer, &parameters);
+			}
+			else if (path == 2u)
+			{
+				kernel.pushConstants(commandBuffer, &addParameters);
+				kernel.push(commandBuffer, &binding);
+			}
+			else
+			{
+				//セットを取れなければ何も結び付けずにディスパッチすることになるので、そこで打ち切る
+				if (!descriptors.allocate(descriptorSetLayout, descriptorSet))
+				{
+					errors.push_back("descriptor set allocation is failed in benchmarkDispatch");
+					break;
+				}
+				kernel.pushConstants(commandBuffer, &addParameters);
+				if (path == 0u)
+				{
+					writeStorageBuffer(device, descriptorSet, binding);
+				}
+				else
+				{
+					kernel.write(descriptorSet, &binding);
+				}
+			}
+			dispatchKernel(commandBuffer, kernel, descriptorSet, elementCount);
+		}
+		const double milliseconds = elapsedMilliseconds(start);
+
+		const uint64_t value = flowQueue(engine, commandBuffer, waits);
+		if (value != 0u)
+		{
+			descriptors.retire(value);
+			wait(makeTicket(engine, value));
+		}
+		snprintf(line, sizeof(line), "%s: %.3f us/job, %u jobs, %u pools\n", pathNames[path], jobs != 0u ? milliseconds * 1000.0 / jobs : 0.0, jobs, descriptors.poolCount());
+		debugOutput(line);
+	}
+	debugOutput("==================\n");
+	setKernel.destroy();
+	pushKernel.destroy();
+}
+
+//ジョブごとにsizeバイトの作業用バッファを取ってカーネルを流し、既定のアロケータで1つずつ作る場合と
+//キューの線形プールから切り出す場合で、確保と記録にかかる時間を比べる。
+void VulkanBase::benchmarkScratch(uint32_t jobCount, VkDeviceSize size)
+{
+	if (jobCount == 0u || size == 0u)
+	{
+		return;
+	}
+	const uint32_t elementCount = uint32_t(size / sizeof(float));
+	const char* pathNames[] = { "default allocator", "linear pool" };
+	char line[256];
+	debugOutput("=====Scratch=====\n");
+	for (uint32_t path = 0; path < 2u; path++)
+	{
+		SubmissionEngine& engine = scheduler.select(JobPriority::Bulk);
+		VkCommandBuffer commandBuffer = engine.begin();
+		vector<TransientBuffer> scratchBuffers;
+		uint32_t jobs = 0u;
+
+		const auto start = chrono::steady_clock::now();
+		for (; jobs < jobCount; jobs++)
+		{
+			TransientBuffer scratch{};
+			if (path == 0u)
+			{
+				VmaAllocationCreateInfo scratchAllocInfo{};
+				scratchAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+				VkBufferCreateInfo bufferCI{};
+				bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				bufferCI.pNext = nullptr;
+				bufferCI.flags = 0;
+				bufferCI.size = size;
+				bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | storageBufferUsage();
+				bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				bufferCI.queueFamilyIndexCount = 0;
+				bufferCI.pQueueFamilyIndices = nullptr;
+				if (vmaCreateBuffer(allocator, &bufferCI, &scratchAllocInfo, &scratch.buffer, &scratch.allocation, nullptr) != VK_SUCCESS)
+				{
+					errors.push_back("vmaCreateBuffer failled in benchmarkScratch");
+					break;
+				}
+			}
+			//記録中のジョブの分はまだ返せないので、プールに収まった分だけ計る
+			else if (transientBuffers(engine).usedBytes() + size > transientBuffers(engine).capacity() || !allocateTransient(engine, size, scratch))
+			{
+				break;
+			}
+			scratchBuffers.push_back(scratch);
+			VkDescriptorBufferInfo binding{};
+			binding.buffer = scratch.buffer;
+			binding.offset = 0u;
+			binding.range = size;
+			AddParameters parameters{};
+			parameters.elementCount = elementCount;
+			addKernel.pushConstants(commandBuffer, &parameters);
+			dispatchKernel(commandBuffer, addKernel, bindKernel(engine, commandBuffer, addKernel, &binding), elementCount);
+		}
+		const double milliseconds = elapsedMilliseconds(start);
+
+		const uint64_t value = flowQueue(engine, commandBuffer);
+		if (path == 1u)
+		{
+			for (const auto& scratch : scratchBuffers)
+			{
+				retireTransient(engine, scratch, value);
+			}
+		}
+		if (value != 0u)
+		{
+			jobDescriptors(engine).retire(value);
+			wait(makeTicket(engine, value));
+		}
+		if (path == 0u)
+		{
+			for (auto& scratch : scratchBuffers)
+			{
+				vmaDestroyBuffer(allocator, scratch.buffer, scratch.allocation);
+			}
+		}
+		snprintf(line, sizeof(line), "%s: %.3f us/job, %u jobs\n", pathNames[path], jobs != 0u ? milliseconds * 1000.0 / jobs : 0.0, jobs);
+		debugOutput(line);
+	}
+	debugOutput("=================\n");
+}
+
+//アリーナのブロックの前に同じ大きさの穴を空けてデフラグし、ブロックを移しても配列の中身が残るかを確かめる
+void VulkanBase::benchmarkDefragment(uint32_t elementCount)
+{
+	const VkDeviceSize size = VkDeviceSize(elementCount) * sizeof(float);
+	char line[256];
+	debugOutput("=====Defragment=====\n");
+	//穴になるバッファを先に置き、その後ろにアリーナのブロックを作らせる
+	ResidentBuffer hole{};
+	if (!createResidentBuffer(bufferArena.blockBufferSize(), hole))
+	{
+		debugOutput("resident buffer for the hole is not available\n");
+		return;
+	}
+	ArenaRange range{};
+	if (!allocateArray(size, range))
+	{
+		destroyResidentBuffer(hole);
+		debugOutput("arena array is not available\n");
+		return;
+	}
+	vector<float> data(elementCount, 1.0f);
+	compute(range, elementCount, upload(data.data(), size, range));
+	destroyResidentBuffer(hole);
+	//穴のメモリは最後に使ったサブミットの完了を確かめてから解放される
+	waitQueue();
+
+	const VmaDefragmentationStats before = defragmenter.stats();
+	const auto start = chrono::steady_clock::now();
+	bool finished = false;
+	for (uint32_t i = 0; i < 16u && !finished; i++)
+	{
+		finished = defragment(UINT32_MAX);
+	}
+	const double milliseconds = elapsedMilliseconds(start);
+	const VmaDefragmentationStats& after = defragmenter.stats();
+
+	//カーネルは1.0を足すので、移した後も2.0が並んでいればよい
+	bool intact = false;
+	download(range, size, [&](const void* result, VkDeviceSize resultSize)
+	{
+		const float* values = static_cast<const float*>(result);
+		intact = true;
+		for (size_t i = 0; i < size_t(resultSize / sizeof(float)); i++)
+		{
+			intact &= values[i] == 2.0f;
+		}
+	});
+	pollReadbacks(true);
+	freeArray(range);
+	snprintf(line, sizeof(line), "%s in %.3f ms, %llu bytes in %u moves, contents %s\n", finished ? "finished" : "not finished", milliseconds,
+		(unsigned long long)(after.bytesMoved - before.bytesMoved), after.allocationsMoved - before.allocationsMoved, intact ? "intact" : "corrupted");
+	debugOutput(line);
+	debugOutput("====================\n");
+}
+
+//ストリーミングのスロットのバッファを別のキューへ渡す。ファミリーが違えば所有権を解放し、
+//同じファミリーならsrcStageからdstStageへの普通のバリアで書き込みを見えるようにする。
+static void releaseStreamBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	const bool sameFamily = srcFamily == dstFamily;
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = srcAccess;
+	//解放ではdstAccessMaskは無視されるので0にする
+	bufferMemoryBarrier.dstAccessMask = sameFamily ? dstAccess : 0u;
+	bufferMemoryBarrier.srcQueueFamilyIndex = sameFamily ? VK_QUEUE_FAMILY_IGNORED : srcFamily;
+	bufferMemoryBarrier.dstQueueFamilyIndex = sameFamily ? VK_QUEUE_FAMILY_IGNORED : dstFamily;
+	bufferMemoryBarrier.buffer = buffer;
+	bufferMemoryBarrier.offset = 0u;
+	bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, srcStage, sameFamily ? dstStage : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+}
+
+//releaseStreamBufferと対になる獲得。同じファミリーなら解放側のバリアとセマフォで足りるので何もしない。
+static void acquireStreamBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	if (srcFamily == dstFamily)
+	{
+		return;
+	}
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	//獲得ではsrcAccessMaskは無視されるので0にする
+	bufferMemoryBarrier.srcAccessMask = 0u;
+	bufferMemoryBarrier.dstAccessMask = dstAccess;
+	bufferMemoryBarrier.srcQueueFamilyIndex = srcFamily;
+	bufferMemoryBarrier.dstQueueFamilyIndex = dstFamily;
+	bufferMemoryBarrier.buffer = buffer;
+	bufferMemoryBarrier.offset = 0u;
+	bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+}
+
+//スロットはstreamDepth個(最低2個)、チャンクはステージングリングにスロット数分収まる大きさに縮める
+void VulkanBase::createStreamExecutor()
+{
+	const uint32_t depth = streamDepth < 2u ? 2u : streamDepth;
+	VkDeviceSize chunkSize = streamChunkSize;
+	if (chunkSize > stagingRing.capacity() / depth)
+	{
+		chunkSize = stagingRing.capacity() / depth;
+	}
+	//チャンクが大きくグループ数がmaxComputeWorkGroupCount[0]を超えると、ディスパッチは縦に折り返して要素数より多く起動する。
+	//add.compはpush_constantの要素数より先を書かないので、スロットの外へは書かない。チャンクの境目はワークグループの倍数に揃える。
+	const VkDeviceSize granule = VkDeviceSize(addKernel.groupInvocationCount()) * sizeof(float);
+	chunkSize = chunkSize / granule * granule;
+	if (chunkSize == 0u)
+	{
+		errors.push_back("streamChunkSize is smaller than a workgroup in createStreamExecutor");
+		return;
+	}
+	//push descriptorで積むならスロットのセットは要らない
+	streamExecutor.create(device, allocator, descriptorAllocator, addKernel.pushDescriptor() ? VK_NULL_HANDLE : descriptorSetLayout, chunkSize, depth, errors);
+	//タイムスタンプの差は同じキューの中でしか取らないので、有効ビットの少ない方に合わせて切り詰めればよい
+	const uint32_t computeBits = profile.queueFamilies[queueFamilyIndex].timestampValidBits;
+	const uint32_t transferBits = profile.queueFamilies[transferEngine->queueFamilyIndex()].timestampValidBits;
+	if (enabled.features12.hostQueryReset == VK_TRUE)
+	{
+		streamExecutor.enableTimestamps(profile.limits().timestampPeriod, computeBits < transferBits ? computeBits : transferBits, errors);
+	}
+}
+
+StreamReport VulkanBase::stream(const float* input, float* output, size_t elementCount)
+{
+	return streamChunks(input, output, elementCount, nullptr, nullptr);
+}
+
+//入力も出力もstd::vectorへ読み込まず、窓ごとにマップしたページから直接ステージングリングへ写し、読み戻しから直接書く。
+//窓をHostImporterで取り込めれば、GPUがページキャッシュを直接読み書きしてmemcpyも無くなる。
+//出力ファイルは作り直す。末尾のfloatに満たない端数は処理しない。
+StreamReport VulkanBase::streamFile(const char* inputFileName, const char* outputFileName)
+{
+	MappedFile inputFile;
+	MappedFile outputFile;
+	StreamReport report{};
+	if (inputFile.open(inputFileName, errors) && outputFile.create(outputFileName, inputFile.size(), errors))
+	{
+		report = streamChunks(nullptr, nullptr, size_t(inputFile.size() / sizeof(float)), &inputFile, &outputFile);
+	}
+	outputFile.close();
+	inputFile.close();
+	return report;
+}
+
+//チャンク0を先に送り、以降はチャンクi+1のアップロード、チャンクiのカーネル、チャンクiのダウンロードの順に積む。
+//転送キューにはU0 U1 D0 U2 D1 ...と並ぶので、チャンクiのカーネルの間にチャンクi+1のアップロードとチャンクi-1のダウンロードが走る。
+//スロットを使い回す前に、そのスロットの前のチャンクのダウンロードだけを待つ。
+//inputFileを渡すとinputとoutputの代わりにファイルの窓を使う。
+StreamReport VulkanBase::streamChunks(const float* input, float* output, size_t elementCount, MappedFile* inputFile, MappedFile* outputFile)
+{
+	if (!streamExecutor.ready())
+	{
+		createStreamExecutor();
+	}
+	streamExecutor.resetReport();
+	if (!streamExecutor.ready() || elementCount == 0u)
+	{
+		return streamExecutor.report();
+	}
+	const size_t chunkElements = size_t(streamExecutor.chunkSize() / sizeof(float));
+	const size_t chunkCount = (elementCount + chunkElements - 1u) / chunkElements;
+	const uint32_t depth = streamExecutor.depth();
+	auto chunkBytes = [&](size_t chunk)
+	{
+		const size_t remaining = elementCount - chunk * chunkElements;
+		return VkDeviceSize((remaining < chunkElements ? remaining : chunkElements) * sizeof(float));
+	};
+	//スロットにチャンクの読み出し元と書き込み先を結び付ける
+	auto prepare = [&](uint32_t slot, size_t chunk)
+	{
+		StreamSlot& streamSlot = streamExecutor.slot(slot);
+		streamSlot.size = chunkBytes(chunk);
+		if (inputFile != nullptr)
+		{
+			return streamMapWindow(slot, uint64_t(chunk) * streamExecutor.chunkSize(), *inputFile, *outputFile);
+		}
+		streamSlot.source = input + chunk * chunkElements;
+		streamSlot.destination = output + chunk * chunkElements;
+		return true;
+	};
+
+	const auto start = chrono::steady_clock::now();
+	uint64_t uploadTicket = prepare(0u, 0u) ? streamUpload(0u) : 0u;
+	for (size_t i = 0; i < chunkCount && uploadTicket != 0u; i++)
+	{
+		uint64_t nextUploadTicket = 0u;
+		if (i + 1u < chunkCount)
+		{
+			const uint32_t next = uint32_t((i + 1u) % depth);
+			streamRetire(next);
+			nextUploadTicket = prepare(next, i + 1u) ? streamUpload(next) : 0u;
+		}
+		const uint32_t slot = uint32_t(i % depth);
+		const uint64_t computeTicket = streamCompute(slot, uploadTicket, uint32_t(chunkBytes(i) / sizeof(float)));
+		streamDownload(slot, computeTicket);
+		//チャンクごとに送り、待ち時間で遅らせない
+		flush();
+		uploadTicket = nextUploadTicket;
+	}
+	for (uint32_t i = 0; i < depth; i++)
+	{
+		streamRetire(i);
+	}
+	StreamReport& report = streamExecutor.report();
+	report.wallMilliseconds = elapsedMilliseconds(start);
+	return report;
+}
+
+//ファイルのoffsetからスロットのsizeバイトの窓を入出力とも写す。
+//窓が取り込めればそれをコピー元、コピー先にし、取り込めなければステージングリングと読み戻しを通す。
+bool VulkanBase::streamMapWindow(uint32_t slot, uint64_t offset, MappedFile& inputFile, MappedFile& outputFile)
+{
+	StreamSlot& streamSlot = streamExecutor.slot(slot);
+	streamSlot.inputView = inputFile.map(offset, size_t(streamSlot.size));
+	streamSlot.outputView = outputFile.map(offset, size_t(streamSlot.size));
+	if (streamSlot.inputView.data == nullptr || streamSlot.outputView.data == nullptr)
+	{
+		errors.push_back("mapping a file window is failed in streamMapWindow");
+		MappedFile::unmap(streamSlot.inputView);
+		MappedFile::unmap(streamSlot.outputView);
+		return false;
+	}
+	streamSlot.source = streamSlot.inputView.data;
+	streamSlot.destination = streamSlot.outputView.data;
+	//ファイルのページを取り込めるかはドライバー次第なので、失敗しても報告せずにステージングへ戻す
+	vector<const char*> importErrors;
+	if (hostImporter.canImport(streamSlot.source, streamSlot.size))
+	{
+		hostImporter.import(const_cast<void*>(streamSlot.source), streamSlot.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, streamSlot.importedInput, importErrors);
+	}
+	if (hostImporter.canImport(streamSlot.destination, streamSlot.size))
+	{
+		hostImporter.import(streamSlot.destination, streamSlot.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, streamSlot.importedOutput, importErrors);
+	}
+	return true;
+}
+
+//スロットの読み出し元からsizeバイトをスロットのバッファへ送り、計算キューへ渡す。
+//取り込んだ窓が無ければステージングリングへ写してからコピーする。
+uint64_t VulkanBase::streamUpload(uint32_t slot)
+{
+	StreamSlot& streamSlot = streamExecutor.slot(slot);
+	const VkDeviceSize size = streamSlot.size;
+	const bool staged = streamSlot.importedInput.buffer == VK_NULL_HANDLE;
+	StagingAllocation staging{};
+	if (!staged)
+	{
+		staging.buffer = streamSlot.importedInput.buffer;
+		staging.offset = 0u;
+	}
+	else
+	{
+		const VkDeviceSize alignment = profile.limits().optimalBufferCopyOffsetAlignment > 4u ? profile.limits().optimalBufferCopyOffsetAlignment : 4u;
+		if (!stagingRing.allocate(size, alignment, staging))
+		{
+			//完了したアップロードの分を解放し、それでも足りなければ全て待つ
+			pollQueue();
+			if (!stagingRing.allocate(size, alignment, staging))
+			{
+				waitQueue();
+				if (!stagingRing.allocate(size, alignment, staging))
+				{
+					errors.push_back("stream chunk exceeds staging ring in streamUpload");
+					return 0u;
+				}
+			}
+		}
+		memcpy(staging.data, streamSlot.source, size_t(size));
+		stagingRing.flush(staging);
+	}
+
+	VkCommandBuffer commandBuffer = transferEngine->begin();
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Upload, false, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	VkBufferCopy region{};
+	region.srcOffset = staging.offset;
+	region.dstOffset = 0u;
+	region.size = size;
+	vkCmdCopyBuffer(commandBuffer, staging.buffer, streamSlot.buffer, 1u, &region);
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Upload, true, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	releaseStreamBuffer(commandBuffer, streamSlot.buffer, transferEngine->queueFamilyIndex(), queueFamilyIndex,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	const uint64_t value = flowQueue(*transferEngine, commandBuffer);
+	if (staged && value != 0u)
+	{
+		stagingRing.retire(value);
+	}
+	return makeTicket(*transferEngine, value);
+}
+
+//アップロードの完了を待ってスロットのチャンクにカーネルを適用し、転送キューへ返す
+uint64_t VulkanBase::streamCompute(uint32_t slot, uint64_t uploadTicket, uint32_t elementCount)
+{
+	StreamSlot& streamSlot = streamExecutor.slot(slot);
+	SubmissionEngine& engine = scheduler.select(JobPriority::Bulk);
+	VkCommandBuffer commandBuffer = engine.begin();
+	acquireStreamBuffer(commandBuffer, streamSlot.buffer, transferEngine->queueFamilyIndex(), queueFamilyIndex,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Compute, false, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	if (addKernel.pushDescriptor())
+	{
+		VkDescriptorBufferInfo descriptorBufferInfo{};
+		descriptorBufferInfo.buffer = streamSlot.buffer;
+		descriptorBufferInfo.offset = 0u;
+		descriptorBufferInfo.range = streamExecutor.chunkSize();
+		addKernel.push(commandBuffer, &descriptorBufferInfo);
+	}
+	AddParameters parameters{};
+	parameters.elementCount = elementCount;
+	addKernel.pushConstants(commandBuffer, &parameters);
+	addKernel.dispatch(commandBuffer, streamSlot.descriptorSet, elementCount);
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Compute, true, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	releaseStreamBuffer(commandBuffer, streamSlot.buffer, queueFamilyIndex, transferEngine->queueFamilyIndex(),
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	vector<TimelineWait> waits;
+	waits.push_back(dependency(uploadTicket, engine, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+	return makeTicket(engine, flowQueue(engine, commandBuffer, waits));
+}
+
+//カーネルの完了を待ってスロットのチャンクを読み戻す。取り込んだ窓があればそこへ直接書き、
+//無ければ読み戻しバッファへ書いてstreamRetireで書き込み先へ写す。
+void VulkanBase::streamDownload(uint32_t slot, uint64_t computeTicket)
+{
+	StreamSlot& streamSlot = streamExecutor.slot(slot);
+	const VkDeviceSize size = streamSlot.size;
+	ReadbackBuffer& readback = streamExecutor.readback();
+	const bool direct = streamSlot.importedOutput.buffer != VK_NULL_HANDLE;
+	uint32_t readbackSlot = 0u;
+	if (computeTicket == 0u || (!direct && !readback.acquire(readbackSlot)))
+	{
+		errors.push_back("no readback slot is available in streamDownload");
+		return;
+	}
+	const VkBuffer dstBuffer = direct ? streamSlot.importedOutput.buffer : readback.buffer(readbackSlot);
+	VkCommandBuffer commandBuffer = transferEngine->begin();
+	acquireStreamBuffer(commandBuffer, streamSlot.buffer, queueFamilyIndex, transferEngine->queueFamilyIndex(),
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Download, false, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	VkBufferCopy region{};
+	region.srcOffset = 0u;
+	region.dstOffset = 0u;
+	region.size = size;
+	vkCmdCopyBuffer(commandBuffer, streamSlot.buffer, dstBuffer, 1u, &region);
+	streamExecutor.writeTimestamp(commandBuffer, slot, StreamStage::Download, true, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	//コピーの書き込みをホストの読み出しから見えるようにする
+	VkBufferMemoryBarrier bufferMemoryBarrier{};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = dstBuffer;
+	bufferMemoryBarrier.offset = 0u;
+	bufferMemoryBarrier.size = size;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0u, 0u, nullptr, 1u, &bufferMemoryBarrier, 0u, nullptr);
+
+	vector<TimelineWait> waits;
+	waits.push_back(dependency(computeTicket, *transferEngine, VK_PIPELINE_STAGE_TRANSFER_BIT));
+	const uint64_t value = flowQueue(*transferEngine, commandBuffer, waits);
+	if (value == 0u)
+	{
+		return;
+	}
+	if (!direct)
+	{
+		void* destination = streamSlot.destination;
+		readback.submit(readbackSlot, value, size, [destination](const void* data, VkDeviceSize size)
+		{
+			memcpy(destination, data, size_t(size));
+		});
+	}
+	streamSlot.downloadTicket = makeTicket(*transferEngine, value);
+}
+
+//スロットのダウンロードが終わるまで待ち、結果を書き込み先へ写してスロットを空ける。ファイルの窓もここで手放す。
+void VulkanBase::streamRetire(uint32_t slot)
+{
+	StreamSlot& streamSlot = streamExecutor.slot(slot);
+	if (streamSlot.downloadTicket != 0u)
+	{
+		wait(streamSlot.downloadTicket);
+		streamExecutor.readback().collect(transferEngine->completedValue());
+		streamExecutor.retire(slot, streamSlot.size);
+	}
+	hostImporter.release(streamSlot.importedInput);
+	hostImporter.release(streamSlot.importedOutput);
+	MappedFile::unmap(streamSlot.inputView);
+	MappedFile::unmap(streamSlot.outputView);
+}
+
+void VulkanBase::streamLog(const StreamReport& report)
+{
+	static const char* stageNames[StreamStageCount] = { "upload", "compute", "download" };
+	char line[256];
+	debugOutput("=====Stream=====\n");
+	snprintf(line, sizeof(line), "chunks: %llu, %.3f MB in %.3f ms, %.3f GB/s\n", (unsigned long long)report.chunkCount,
+		double(report.bytes) / 1.0e6, report.wallMilliseconds, report.wallMilliseconds > 0.0 ? double(report.bytes) / (report.wallMilliseconds * 1.0e6) : 0.0);
+	debugOutput(line);
+	if (!report.timestamps)
+	{
+		debugOutput("stages: timestamps are not available on this device\n");
+		debugOutput("================\n");
+		return;
+	}
+	//GPUが最も長く占有していた段が律速している
+	uint32_t bottleneck = 0u;
+	for (uint32_t i = 0; i < StreamStageCount; i++)
+	{
+		const StreamStageStats& stage = report.stages[i];
+		snprintf(line, sizeof(line), "%s: %.3f ms busy, %.3f GB/s\n", stageNames[i], stage.milliseconds,
+			stage.milliseconds > 0.0 ? double(stage.bytes) / (stage.milliseconds * 1.0e6) : 0.0);
+		debugOutput(line);
+		if (stage.milliseconds > report.stages[bottleneck].milliseconds)
+		{
+			bottleneck = i;
+		}
+	}
+	snprintf(line, sizeof(line), "bottleneck: %s\n", stageNames[bottleneck]);
+	debugOutput(line);
+	debugOutput("================\n");
+}
+
+//deviceLocalBufferのsrcOffsetからsizeバイトをホストへ読み戻すサブミットを積む。完了は待たない。
+//結果はpollReadbacksがcallbackへ渡す。受け取り票はisReadbackReadyで完了を調べるのに使う。
+ReadbackTicket VulkanBase::download(VkDeviceSize size, VkDeviceSize srcOffset, ReadbackBuffer::Callback callback, uint64_t after)
+{
+	ReadbackTicket ticket{};
+	if (srcOffset + size > deviceLocalBufferSize || size > readbackBuffer.slotSize())
+	{
+		errors.push_back("download range exceeds readback slot in download");
+		return ticket;
+	}
+	return downloadStaged(deviceLocalBuffer, srcOffset, size, callback, { after });
+}
+
+//srcBufferのsrcOffsetからsizeバイトを読み戻しのスロットへコピーする。deviceLocalBufferなら転送キューへ持ち主を移す。
+ReadbackTicket VulkanBase::downloadStaged(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkDeviceSize size, ReadbackBuffer::Callback callback, const vector<uint64_t>& afters)
+{
+	ReadbackTicket ticket{};
+	uint32_t slot = 0u;
+	if (!readbackBuffer.acquire(slot))
+	{
+		//全てのスロットが使用中なら一番古い結果を受け渡して空ける
+		pollReadbacks(true);
+		if (!readbackBuffer.acquire(slot))
+		{
+			errors.push_back("no readback slot is available in download");
+			return ticket;
+		}
+	}
+	VkCommandBuffer commandBuffer = transferEngine->begin();
+	vector<TimelineWait> waits = srcBuffer == deviceLocalBuffer ? acquireDeviceLocalBuffer(commandBuffer, *transferEngine) : vector<TimelineWait>();
+	readBuffer(commandBuffer, srcBuffer, srcOffset, readbackBuffer.buffer(slot), size);
+	for (const auto after : afters)
+	{
+		if (after != 0u)
+		{
+			waits.push_back(dependency(after, *transferEngine, VK_PIPELINE_STAGE_TRANSFER_BIT));
+		}
+	}
+	const uint64_t value = flowQueue(*transferEngine, commandBuffer, waits);
+	if (value == 0u)
+	{
+		return ticket;
+	}
+	readbackBuffer.submit(slot, value, size, callback);
+	ticket.slot = slot;
+	ticket.value = makeTicket(*transferEngine, value);
+	return ticket;
+}
+
+ReadbackTicket VulkanBase::download(const ArenaRange& range, VkDeviceSize size, ReadbackBuffer::Callback callback, uint64_t after)
+{
+	if (!bufferArena.valid(range) || size > range.range || size > readbackBuffer.slotSize())
+	{
+		errors.push_back("download range exceeds arena range or readback slot in download");
+		return ReadbackTicket{};
+	}
+	ReadbackTicket ticket = downloadStaged(bufferArena.blockBuffer(range.block), range.offset, size, callback, { after });
+	touchArena(range.block, ticket.value);
+	return ticket;
+}
+
+ReadbackTicket VulkanBase::download(const ResidentBuffer& buffer, VkDeviceSize size, ReadbackBuffer::Callback callback, uint64_t after)
+{
+	if (buffer.handle == ResidentInvalidHandle || size > buffer.size || size > readbackBuffer.slotSize())
+	{
+		errors.push_back("download range exceeds resident buffer or readback slot in download");
+		return ReadbackTicket{};
+	}
+	ReadbackTicket ticket = downloadStaged(residency.buffer(buffer.handle), 0u, size, callback, { after, residency.ticket(buffer.handle) });
+	residency.touch(buffer.handle, ticket.value);
+	return ticket;
+}
+
+bool VulkanBase::isReadbackReady(const ReadbackTicket& ticket)
+{
+	return ticket.value != 0u && isComplete(ticket.value);
+}
+
+//完了した読み戻しのcallbackを呼ぶ。waitがtrueなら実行中のサブミットの完了を待ってから渡す。
+void VulkanBase::pollReadbacks(bool wait)
+{
+	if (wait)
+	{
+		waitQueue();
+	}
+	else
+	{
+		pollQueue();
+	}
+	readbackBuffer.collect(transferEngine->completedValue());
+}
+
+const DeviceProfile& VulkanBase::deviceProfile() const
+{
+	return profile;
+}
+
+void VulkanBase::terminate()
+{
+	//initializeがデバイスを作る前に失敗していれば、インスタンスだけを破棄する
+	if (device != VK_NULL_HANDLE)
+	{
+		terminateDevice();
+	}
+	if (debugMessenger != VK_NULL_HANDLE)
+	{
+		auto pfnDestroyDebugUtilsMessenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+		pfnDestroyDebugUtilsMessenger(instance, debugMessenger, nullptr);
+	}
+	vkDestroyInstance(instance, hostMemoryTracker.callbacks());
+}
+
+void VulkanBase::terminateDevice()
+{
+	vkDeviceWaitIdle(device);
+	//受け取られていない結果を渡してから破棄する
+	pollReadbacks(true);
+	unbindInput();
+	streamExecutor.destroy();
+	addKernel.destroy();
+	addressKernel.destroy();
+	bindlessKernel.destroy();
+	arenaKernel.destroy();
+	savePipelineCache(PipelineCacheFileName);
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	for (auto& jobDescriptorAllocator : jobDescriptorAllocators)
+	{
+		jobDescriptorAllocator.destroy();
+	}
+	descriptorAllocator.destroy();
+	layoutCache.destroy();
+	bindlessTable.destroy();
+	vkDestroyShaderModule(device, shaderModule, nullptr);
+	vkDestroyShaderModule(device, addressShaderModule, nullptr);
+	vkDestroyShaderModule(device, bindlessShaderModule, nullptr);
+	for (auto& engine : queueEngines)
+	{
+		engine.destroy();
+	}
+	readbackBuffer.destroy();
+	defragmenter.destroy();
+	bufferArena.destroy();
+	residency.destroy();
+	for (auto& transientPool : transientPools)
+	{
+		transientPool.destroy();
+	}
+	if (persistentPool != VK_NULL_HANDLE)
+	{
+		vmaDestroyPool(allocator, persistentPool);
+	}
+	//ステージングバッファを破棄
 	vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+	vmaDestroyBuffer(allocator, deviceLocalBuffer, deviceLocalBufferAllocation);
+	vmaDestroyAllocator(allocator);
+	//デバイスとインスタンスは作成時と同じアロケーションコールバックで破棄する
+	vkDestroyDevice(device, hostMemoryTracker.callbacks());
+	device = VK_NULL_HANDLE;
 }
\ No newline at end of file
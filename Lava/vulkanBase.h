@@ -1,63 +1,319 @@
 #pragma once
 
+//LAVA_HEADLESSを定義するとGLFWやWSIを使わない計算専用の構成になる
+#if !defined(LAVA_HEADLESS)
+#if defined(_WIN32)
 #define VK_USE_PLATFORM_WIN32_KHR
-#define GLFW_INCLUDE_VULKAN
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <windows.h>
+#endif
+#define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
+#endif
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_layer.h>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <chrono>
 #include "vk_mem_alloc.h"
+#include "computeKernel.h"
+#include "capabilities.h"
+#include "deviceProfile.h"
+#include "stagingRing.h"
+#include "readbackBuffer.h"
+#include "hostImport.h"
+#include "submissionEngine.h"
+#include "queueScheduler.h"
+#include "streamExecutor.h"
+#include "shaderLoader.h"
+#include "spirvReflection.h"
+#include "layoutCache.h"
+#include "descriptorAllocator.h"
+#include "bindlessTable.h"
+#include "bufferArena.h"
+#include "transientPool.h"
+#include "residencyManager.h"
+#include "defragmenter.h"
+#include "memoryTracker.h"
 
+#if defined(_MSC_VER)
 #pragma comment(lib, "vulkan-1.lib")
+#endif
 
 using namespace std;
 
+//初期化にかかった時間とドライバーが確保したホストメモリ
+struct StartupReport
+{
+	double instanceMilliseconds;
+	double deviceMilliseconds;
+	size_t instanceHostBytes;
+	size_t deviceHostBytes;
+	uint32_t advertisedInstanceExtensions;
+	uint32_t enabledInstanceExtensions;
+	uint32_t advertisedDeviceExtensions;
+	uint32_t enabledDeviceExtensions;
+};
+
 class VulkanBase
 {
 public:
 	VulkanBase();
 	virtual ~VulkanBase() {};
-	void initialize(GLFWwindow* window, const char* appTitle);
+	bool initialize(const char* appTitle, const VulkanCapabilities& capabilities = VulkanCapabilities());
+#if !defined(LAVA_HEADLESS)
+	bool initialize(GLFWwindow* window, const char* appTitle, const VulkanCapabilities& capabilities = VulkanCapabilities());
+#endif
 	void terminate();
 	void errorLog();
+	void startupLog();
+	void submissionLog();
+	//compute/upload/downloadはサブミットのタイムラインの値をチケットとして返す
+	uint64_t compute(uint32_t elementCount, uint64_t after = 0u, JobPriority priority = JobPriority::Bulk);
+	uint64_t upload(const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0u);
+	ReadbackTicket download(VkDeviceSize size, VkDeviceSize srcOffset = 0u, ReadbackBuffer::Callback callback = nullptr, uint64_t after = 0u);
+	//小さな配列をアリーナのバッファから切り出す。
+	//freeArrayは配列を使うサブミットが完了してから呼ぶこと。
+	bool allocateArray(VkDeviceSize size, ArenaRange& range);
+	void freeArray(ArenaRange& range);
+	//配列を自分のカーネルへ結び付けるためのバッファと範囲。デフラグでブロックが移るとバッファが替わるので、結び付けるたびに引くこと。
+	VkDescriptorBufferInfo arrayBinding(const ArenaRange& range) const;
+	//ジョブの間だけ使う作業用バッファをengineの線形プールから切り出す。
+	//ジョブをサブミットしたら、その値をretireTransientに渡すこと。渡すまでバッファはプールへ返らない。
+	bool allocateTransient(SubmissionEngine& engine, VkDeviceSize size, TransientBuffer& buffer);
+	void retireTransient(SubmissionEngine& engine, const TransientBuffer& buffer, uint64_t value);
+	//アリーナの配列に対するupload/compute/download。computeはダイナミックオフセットかbindlessの要素のオフセットで配列を渡す。
+	//uploadはブロックを使っている未完了のジョブの後に書くので、読み終わるのを待たずに呼んでよい
+	uint64_t upload(const void* data, VkDeviceSize size, const ArenaRange& range, uint64_t after = 0u);
+	uint64_t compute(const ArenaRange& range, uint32_t elementCount, uint64_t after = 0u, JobPriority priority = JobPriority::Bulk);
+	ReadbackTicket download(const ArenaRange& range, VkDeviceSize size, ReadbackBuffer::Callback callback = nullptr, uint64_t after = 0u);
+	//デバイスメモリが予算を超えそうな時にホストへ追い出せるバッファ。
+	//computeは追い出されていれば戻してから使い、upload/downloadは今ある方の実体を読み書きする。
+	bool createResidentBuffer(VkDeviceSize size, ResidentBuffer& buffer);
+	void destroyResidentBuffer(ResidentBuffer& buffer);
+	uint64_t upload(const void* data, VkDeviceSize size, const ResidentBuffer& buffer);
+	uint64_t compute(const ResidentBuffer& buffer, uint32_t elementCount, uint64_t after = 0u, JobPriority priority = JobPriority::Bulk);
+	ReadbackTicket download(const ResidentBuffer& buffer, VkDeviceSize size, ReadbackBuffer::Callback callback = nullptr, uint64_t after = 0u);
+	void residencyLog();
+	//長く持つバッファのプールをデフラグのパス単位で詰め、maxMicrosecondsを過ぎたら次のパスに入らずに戻る。
+	//まだサブミットが読み書きしている確保はそのパスでは動かさず、待つのは移すコピーの完了だけ。最後まで詰め終えたらtrueを返す。
+	bool defragment(uint32_t maxMicroseconds);
+	void flush();
+	bool isComplete(uint64_t ticket);
+	void wait(uint64_t ticket);
+	bool isReadbackReady(const ReadbackTicket& ticket);
+	void pollReadbacks(bool wait = false);
+	bool bindInput(void* data, VkDeviceSize size);
+	void unbindInput();
+	//バッファをbindlessの配列に登録し、カーネルへpush_constantで渡す添字を返す。bindlessを使っていなければBindlessInvalidHandleを返す。
+	uint32_t registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	//afterのチケットが完了してから登録を外す。0なら今外す。
+	void unregisterBuffer(uint32_t handle, uint64_t after = 0u);
+	void benchmarkUpload(VkDeviceSize size, uint32_t iterations);
+	void benchmarkDispatch(uint32_t jobCount);
+	void benchmarkScratch(uint32_t jobCount, VkDeviceSize size);
+	void benchmarkDefragment(uint32_t elementCount);
+	//elementCount個のfloatをチャンクに分けて転送、計算、読み戻しを重ねて流し、outputへ書く。完了まで戻らない。
+	StreamReport stream(const float* input, float* output, size_t elementCount);
+	//float配列を収めたファイルを窓ごとにマップして同じように流し、同じ大きさの出力ファイルへ書く
+	StreamReport streamFile(const char* inputFileName, const char* outputFileName);
+	void streamLog(const StreamReport& report);
+	const DeviceProfile& deviceProfile() const;
+	//initializeの前に変更すると反映される
+	VkDeviceSize stagingBufferSize;
+	VkDeviceSize deviceLocalBufferSize;
+	VkDeviceSize readbackBufferSize;
+	uint32_t readbackSlotCount;
+	//デバイスが対応していれば、deviceLocalBufferをマップして直接書き込む
+	bool enableZeroCopy;
+	//サブミットはこれだけ溜まるか、これだけ経つとまとめて送る
+	uint32_t maxBatchJobs;
+	uint32_t maxBatchMicroseconds;
+	//転送専用のキューファミリー、無ければ計算ファミリーの2本目のキューで転送を行う
+	bool enableTransferQueue;
+	//計算ファミリーのキューごとの優先度。足りない分は先頭を1.0、残りを0.5とする。
+	vector<float> computeQueuePriorities;
+	//VK_KHR_push_descriptorがあれば、ジョブのバッファをセットを介さずコマンドバッファへ積む
+	bool enablePushDescriptor;
+	//bufferDeviceAddressがあれば、compute()はバッファをデスクリプタではなくpush_constantのアドレスで渡す。
+	//enableBindlessとは同時に使えず、両方を立てるとinitializeがエラーを積んでこちらを使う。
+	bool enableBufferDeviceAddress;
+	//descriptor indexingがあれば、全てのバッファを1つのセットの配列に登録し、compute()は添字をpush_constantで渡す。
+	//容量はデバイスの上限に切り詰める。
+	bool enableBindless;
+	uint32_t bindlessBufferCapacity;
+	uint32_t bindlessImageCapacity;
+	//allocateArrayで切り出すアリーナの1ブロックの大きさと、1つの配列の大きさの上限
+	VkDeviceSize arenaBlockSize;
+	VkDeviceSize arenaRangeLimit;
+	//ジョブの間だけ使う作業用バッファを切り出す、キューごとの線形プールの大きさ
+	VkDeviceSize transientPoolSize;
+	//デバイスローカルのヒープの予算に対するこの割合を超えると、createResidentBufferのバッファを古いものからホストへ追い出す
+	float residencyWatermark;
+	//defragment()の1回のパスで動かすバイト数と確保の数の上限。バイト数はアリーナのブロックより小さければブロックの大きさにする。
+	VkDeviceSize defragmentBytesPerPass;
+	uint32_t defragmentAllocationsPerPass;
+	//stream()のチャンクの大きさと、同時に使うスロットの数。チャンクはステージングリングに収まるよう縮める。
+	VkDeviceSize streamChunkSize;
+	uint32_t streamDepth;
 protected:
 	VkInstance instance;
+	VulkanCapabilities capabilities;
+	EnabledCapabilities enabled;
+	HostMemoryTracker hostMemoryTracker;
+	StartupReport startupReport;
+	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice;
 	vector<VkPhysicalDevice> physicalDevices;
+	vector<DeviceProfile> deviceProfiles;
+	DeviceProfile profile;
 	VkDevice device;
+	VkPipelineCache pipelineCache;
 	uint32_t queueFamilyIndex;
+	VkQueue queue;
+	//計算ファミリーの全てのキュー。queueは先頭のもの。
+	vector<VkQueue> computeQueues;
+	uint32_t transferQueueFamilyIndex;
+	uint32_t transferQueueIndex;
+	VkQueue transferQueue;
 	VmaAllocator allocator;
+	//initializeからterminateまで持ち続けるデバイスローカルのバッファを置く普通のプール
+	VmaPool persistentPool;
+	//ジョブの作業用バッファの線形プール。queueEnginesと同じ並びで、そのキューのタイムラインの値でretireする。
+	vector<TransientPool> transientPools;
+	ResidencyManager residency;
+	//persistentPoolを詰める。動かせるのはアリーナのブロックと預かったバッファだけで、他の確保は動かさない。
+	Defragmenter defragmenter;
 	VkBuffer stagingBuffer;
 	VkBuffer deviceLocalBuffer;
 	VmaAllocation stagingBufferAllocation;
 	VmaAllocation deviceLocalBufferAllocation;
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
-	VkFence fence;
+	//ゼロコピーの時だけ有効。nullptrならステージングリングを通す。
+	void* deviceLocalBufferMapped;
+	StagingRing stagingRing;
+	ReadbackBuffer readbackBuffer;
+	HostImporter hostImporter;
+	//bindInputで取り込んだホストの配列。無ければbinding 0はdeviceLocalBufferを指す。
+	ImportedBuffer importedInput;
+	//作成したキューごとに1つ。計算ファミリーのキューが先頭から並び、転送専用ファミリーのキューがあれば最後に付く。
+	//チケットの上位ビットはこの添字。
+	vector<SubmissionEngine> queueEngines;
+	QueueScheduler scheduler;
+	SubmissionEngine* transferEngine;
+	//転送キューが無く、転送を計算キューの先頭で行っている
+	bool transferQueueShared;
+	//deviceLocalBufferを今どちらのキューが持っているか
+	SubmissionEngine* deviceLocalBufferOwner;
 	VkShaderModule shaderModule;
-	VkDescriptorPool descriptorPool;
+	//initializeからterminateまで持ち続けるセットを切り出す。retireしないので途中でリセットされない。
+	DescriptorAllocator descriptorAllocator;
+	//add.compのset 0のレイアウト。layoutCacheが持つ。
 	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorSet descriptorSet;
+	LayoutCache layoutCache;
+	ShaderInterface addInterface;
+	//push descriptorが使えない時にジョブごとのセットを切り出す。queueEnginesと同じ並びで、そのキューのタイムラインの値でretireする。
+	vector<DescriptorAllocator> jobDescriptorAllocators;
+	ComputeKernel addKernel;
+	//addAddress.comp。useDeviceAddressの時だけ作る。
+	VkShaderModule addressShaderModule;
+	ShaderInterface addressInterface;
+	ComputeKernel addressKernel;
+	bool useDeviceAddress;
+	//addBindless.comp。useBindlessの時だけ作る。
+	BindlessTable bindlessTable;
+	VkShaderModule bindlessShaderModule;
+	ShaderInterface bindlessInterface;
+	ComputeKernel bindlessKernel;
+	bool useBindless;
+	uint32_t deviceLocalBufferHandle;
+	uint32_t importedInputHandle;
+	//allocateArrayの配列を切り出すバッファ。計算と転送のキューで共有し、持ち主を移さない。
+	BufferArena bufferArena;
+	//add.compのbinding 0をダイナミックにしたもの。セットはアリーナのブロックごとに1つ作って使い続ける。
+	ShaderInterface arenaInterface;
+	VkDescriptorSetLayout arenaSetLayout;
+	ComputeKernel arenaKernel;
+	vector<VkDescriptorSet> arenaDescriptorSets;
+	//ブロックごと、キューごとに最後に読み書きしたサブミットのチケット。デフラグで動かしてよいかを見る。
+	vector<uint64_t> arenaTickets;
+	//bindlessではブロック全体を1つの要素に登録する。ブロックがストレージバッファの範囲に収まらなければ0で、セットの方を使う。
+	VkDeviceSize arenaBindlessRange;
+	vector<uint32_t> arenaBindlessHandles;
+	//createResidentBufferのバッファを登録した添字と範囲。追い出しや戻しで外し、次のcomputeで登録し直す。
+	struct ResidentBinding
+	{
+		uint32_t handle;
+		VkDeviceSize size;
+	};
+	vector<ResidentBinding> residentBindings;
+	StreamExecutor streamExecutor;
 	void createInstance(const char* appTitle);
-	void selectPhysicalDevices();
-	void createDevice();
+	void createDebugMessenger();
+	bool selectPhysicalDevices();
+	bool createDevice();
+	void terminateDevice();
+	void createPipelineCache(const char* fileName);
+	void savePipelineCache(const char* fileName);
 	void createMemoryAllocator();
 	void createStagingBuffer();
 	void createDeviceLocalBuffer();
-	void createCommandPool();
-	void createCommandBuffer();
-	void copyBuffer();
-	void createFence();
-	void flowQueue(VkQueue queue);
+	void createReadbackBuffer();
+	void createHostImporter();
+	void createSubmissionEngine();
+	void createMemoryPools();
+	TransientPool& transientBuffers(const SubmissionEngine& engine);
+	vector<uint32_t> sharedQueueFamilyIndices() const;
+	void createResidencyManager();
+	void evictColdBuffers(uint32_t exclude, VkDeviceSize incoming);
+	uint64_t moveResident(const ResidencyMove& move);
+	bool ticketCompleted(uint64_t ticket);
+	void copyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+	uint64_t uploadStaged(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, const vector<uint64_t>& afters = vector<uint64_t>());
+	void uploadDirect(const void* data, VkDeviceSize size, VkDeviceSize dstOffset);
+	ReadbackTicket downloadStaged(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkDeviceSize size, ReadbackBuffer::Callback callback, const vector<uint64_t>& afters);
+	void readBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize size);
+	uint64_t flowQueue(SubmissionEngine& engine, VkCommandBuffer commandBuffer, const vector<TimelineWait>& waits = vector<TimelineWait>());
+	vector<TimelineWait> acquireDeviceLocalBuffer(VkCommandBuffer commandBuffer, SubmissionEngine& engine);
+	TimelineWait dependency(uint64_t ticket, SubmissionEngine& waiter, VkPipelineStageFlags stage);
+	SubmissionEngine& ticketEngine(uint64_t ticket);
+	uint64_t makeTicket(const SubmissionEngine& engine, uint64_t value) const;
+	float computeQueuePriority(uint32_t queueIndex) const;
+	VkPipelineStageFlags engineStages(const SubmissionEngine& engine) const;
+	void waitQueue();
+	void pollQueue();
 	void createDescriptorPool();
 	void createDescriptorSetLayout();
-	void createDescriptorSet();
-	void updateDescriptorSet();
+	DescriptorAllocator& jobDescriptors(const SubmissionEngine& engine);
+	VkDescriptorBufferInfo inputBinding() const;
+	void createComputeKernel();
+	void createAddressKernel();
+	void createBindlessKernel();
+	void createBufferArena();
+	VkDescriptorSet arenaDescriptorSet(uint32_t block);
+	void writeArenaDescriptorSet(VkDescriptorSet descriptorSet, uint32_t block);
+	uint64_t touchArena(uint32_t block, uint64_t ticket);
+	vector<uint64_t> arenaPending(uint32_t block);
+	uint32_t arenaBindlessHandle(uint32_t block);
+	uint32_t residentBindlessHandle(const ResidentBuffer& buffer);
+	bool allocationBusy(VmaAllocation allocation);
+	bool createMovedBuffer(const VmaDefragmentationMove& move, VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size);
+	VkDeviceAddress bufferAddress(VkBuffer buffer) const;
+	VkBufferUsageFlags storageBufferUsage() const;
+	VkDescriptorSet bindKernel(SubmissionEngine& engine, VkCommandBuffer commandBuffer, ComputeKernel& kernel, const VkDescriptorBufferInfo* bufferInfos);
+	void dispatchKernel(VkCommandBuffer commandBuffer, ComputeKernel& kernel, VkDescriptorSet descriptorSet, uint32_t elementCount, uint32_t dynamicOffsetCount = 0u, const uint32_t* dynamicOffsets = nullptr);
+	void createStreamExecutor();
+	StreamReport streamChunks(const float* input, float* output, size_t elementCount, MappedFile* inputFile, MappedFile* outputFile);
+	bool streamMapWindow(uint32_t slot, uint64_t offset, MappedFile& inputFile, MappedFile& outputFile);
+	uint64_t streamUpload(uint32_t slot);
+	uint64_t streamCompute(uint32_t slot, uint64_t uploadTicket, uint32_t elementCount);
+	void streamDownload(uint32_t slot, uint64_t computeTicket);
+	void streamRetire(uint32_t slot);
 	VkShaderModule createShaderModule(const char* fileName);
+	VkShaderModule createShaderModule(const SpirvBinary& spirv);
 	vector<const char*>errors;
 };